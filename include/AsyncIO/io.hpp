@@ -0,0 +1,68 @@
+#ifndef _ASYNCIO_HPP_
+#define _ASYNCIO_HPP_
+
+#include <ThreadPool/pool.hpp>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+/*
+ *  Batched asynchronous file I/O.
+ *  Sources are read a batch at a time with every open, read and close of the
+ *  batch in flight at once. Outputs are queued by the compute threads and a
+ *  background writer puts them on disk in batches, compiling never waits on
+ *  the filesystem.
+ *  The I/O goes through io_uring where the kernel offers it, otherwise reads
+ *  run on a small pool of I/O threads and the writer uses plain streams.
+ */
+class AsyncIO {
+    class Ring;                                     /* one io_uring instance, not shared between threads */
+
+    typedef struct job_struct {
+        fs::path file;
+        string content;
+        function<void()> task;                      /* set for deferred tasks, file and content are unused then */
+    } Job;
+
+    bool uring;                                     /* io_uring is usable, probed once at construction */
+    unique_ptr<ThreadPool> readers;                 /* fallback readers without io_uring */
+
+    mutex queueLock;
+    condition_variable queued;                      /* signalled when a job is queued or the writer stops */
+    condition_variable finished;                    /* signalled when the writer finished a batch */
+    deque<Job> jobs;
+    size_t nQueued = 0;                             /* jobs ever queued, guarded by queueLock */
+    size_t nFinished = 0;                           /* jobs ever finished, guarded by queueLock */
+    bool stopping = false;
+    thread writer;
+
+    void runWriter();
+    void writeBatch(Ring *ring, vector<Job> &batch);
+
+    AsyncIO(const AsyncIO &) = delete;
+    AsyncIO &operator=(const AsyncIO &) = delete;
+public:
+    AsyncIO();
+    ~AsyncIO();                                     /* finishes every queued job */
+
+    bool usesUring() const { return uring; }
+
+    /* contents of every file in order, errors[i] is the errno of a file that can't be read (0 if it was) */
+    vector<string> readAll(const vector<fs::path> &files, vector<int> &errors);
+
+    void write(const fs::path &file, string content);     /* queued, returns at once */
+    void defer(function<void()> task);                    /* run on the writer after the jobs queued before it */
+    void flush();                                         /* wait until every job queued so far is done */
+};
+
+#endif
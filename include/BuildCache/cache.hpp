@@ -0,0 +1,53 @@
+#ifndef _BUILDCACHE_HPP_
+#define _BUILDCACHE_HPP_
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+/*
+ *  Persistent cache of compiled .vm files.
+ *  An entry is keyed by a hash of the source bytes salted with the compiler
+ *  version and every option that changes the generated code, so a hit can be
+ *  restored without lexing or parsing the class at all.
+ *  Entries are written to a temporary file and renamed into place, several
+ *  compiler processes can share one cache directory.
+ *
+ *  An entry is one .entry file: the number of classes whose interface the
+ *  compile consumed, one line per class with the interface hash it saw, then
+ *  the .vm code. It only hits while all of those interfaces are unchanged,
+ *  and code and dependencies land with one rename, so two processes storing
+ *  the same key never mix one's dependencies with the other's code.
+ *
+ *  A resident cache (the compile server's) also keeps every entry in memory,
+ *  an empty cache directory then means a memory only cache.
+ */
+class BuildCache {
+    fs::path dir;
+    bool resident;
+
+    fs::path entryPath(const string &key) const;
+    fs::path tmpPathOf(const fs::path &file) const;
+    void storeFile(const string &content, const fs::path &to) const;
+public:
+    BuildCache(const fs::path &cacheDir, bool keepResident = false) : dir {cacheDir}, resident {keepResident} {}
+
+    static uint64_t hash(string_view data, uint64_t seed = 0xcbf29ce484222325ULL);    /* 64 bit FNV-1a */
+    static string keyOf(string_view source, string_view salt);                         /* hex cache key */
+
+    typedef vector<pair<string, uint64_t>> Dependencies;                /* consumed class name and its interface hash */
+
+    /* load the cached .vm into vm, false on a miss or when interfaceHashOf disagrees with a recorded dependency */
+    bool restore(const string &key, string &vm, const function<uint64_t(const string &)> &interfaceHashOf) const;
+    void store(const string &key, const string &vm, const Dependencies &deps) const;     /* add a freshly compiled .vm */
+};
+
+#endif
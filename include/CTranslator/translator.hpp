@@ -0,0 +1,48 @@
+#ifndef _CTRANSLATOR_HPP_
+#define _CTRANSLATOR_HPP_
+
+#include <VMProgram/program.hpp>
+#include <VMWriter/writer.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/*
+ *  Lowers VM programs to one portable C file, built with the system compiler
+ *  against the Jack OS in runtime/ (cc -O2 -Iruntime prog.c runtime/jackos.c).
+ *  Every VM function becomes a C function Class__name(a0, a1, ...) returning jack_word.
+ *  The VM stack depth is known at every instruction, so the stack slots,
+ *  locals, temps and the this/that pointers are plain C locals the C compiler
+ *  keeps in registers; only the heap (this, that) goes through jack_ram.
+ *  Statics are one array per file.
+ *
+ *  The arity of a function is not part of the VM code, it is the most
+ *  arguments any call passes or the function uses. Functions the program
+ *  doesn't define come from the runtime, whose definitions are weak so a
+ *  program that brings its own OS classes as .vm files overrides them.
+ */
+class CTranslator {
+    typedef struct unit_struct {
+        string fileName;
+        VMProgram program;
+    } Unit;
+
+    typedef struct function_info_struct {
+        bool defined = false;
+        uint32_t arity = 0;
+    } FunctionInfo;
+
+    vector<Unit> units;
+    map<string, FunctionInfo> functions;
+
+    string translateFunction(const Unit &unit, size_t begin, size_t end);     /* code[begin] is the function command */
+    string prototype(const string &name) const;
+public:
+    void translate(const VMProgram &program, const string &fileName);   /* kept until finish(), arities need every call */
+    string finish();                                /* the whole C file, throws runtime_error on VM code it can't map */
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef _CLASSINDEX_HPP_
+#define _CLASSINDEX_HPP_
+
+#include <JackTokenizer/tokenizer.hpp>
+#include <ThreadPool/pool.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+typedef struct subroutine_struct {
+    Keyword kind;                                   /* CONSTRUCTOR, FUNCTION or METHOD */
+    size_t nParams;                                 /* declared parameters, not counting the implicit this */
+    string returnType;
+    uint64_t bodyHash;                              /* hash of the body's tokens, for consumers of inlinable bodies */
+} Subroutine;
+
+typedef struct class_summary_struct {
+    uint64_t sourceHash;                            /* hash of the .jack file the summary was made from */
+    uint64_t interfaceHash;                         /* kinds, arities and return types only, what other classes consume */
+    map<string, Subroutine> subroutines;            /* ordered, so summary files and hashes are deterministic */
+} ClassSummary;
+
+/*
+ *  Program-wide index of every class's subroutine signatures.
+ *  It is built once by a declaration-only pre-pass over all the files
+ *  that are going to be compiled together, and is read-only afterwards,
+ *  so any number of compilation engines can consult it concurrently.
+ *
+ *  For incremental builds the summary of each class is also kept in a
+ *  compact binary .vmi file next to its .vm; while the source hash still
+ *  matches, the class is loaded from there without lexing it again.
+ *
+ *  .vmi layout (integers are LEB128 varints, hashes 8 bytes little endian):
+ *      "JVMI" version sourceHash className nSubroutines
+ *      { name kind(0 constructor, 1 function, 2 method) nParams returnType bodyHash } * nSubroutines
+ *  strings are a varint length followed by the bytes
+ *
+ *  Resident processes (the compile server) build with resident set, the
+ *  summaries are then also kept in memory, keyed by source hash.
+ */
+class ClassIndex {
+    unordered_map<string, ClassSummary> classes;
+
+    inline static const uint8_t SUMMARY_VERSION = 1;
+
+    static bool scanClass(istream &in, string &className, ClassSummary &summary);
+    static bool readSummary(const fs::path &file, uint64_t sourceHash, string &className, ClassSummary &summary);
+    static void writeSummary(const fs::path &file, const string &className, const ClassSummary &summary);
+    static uint64_t interfaceHashOf(const ClassSummary &summary);
+public:
+    /* scan the sources in parallel, with useSummaries .vmi files are read when current and written otherwise */
+    static ClassIndex build(const vector<fs::path> &files, const vector<string> &sources, ThreadPool &pool,
+            bool useSummaries = false, bool resident = false);
+
+    /* used by long running processes between compiles, never while engines read the index */
+    string update(const string &source);                        /* (re)index one class, returns its name, empty if malformed */
+    void remove(string_view className);
+
+    bool hasClass(string_view className) const;
+    vector<string> classNames() const;                          /* sorted */
+    const Subroutine *find(string_view className, string_view subroutineName) const;
+    uint64_t interfaceHash(string_view className) const;        /* 0 for classes outside the index */
+};
+
+#endif
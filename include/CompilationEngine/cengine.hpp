@@ -1,10 +1,17 @@
 #ifndef _COMPILATIONENGINE_HPP_
 #define _COMPILATIONENGINE_HPP_
 
+#include <ClassIndex/index.hpp>
+#include <CompileError/error.hpp>
 #include <JackTokenizer/tokenizer.hpp>
+#include <Profile/profile.hpp>
 #include <SymbolTable/table.hpp>
+#include <ThreadPool/pool.hpp>
 #include <VMWriter/writer.hpp>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <set>
 #include <string>
 
 using namespace std;
@@ -16,7 +23,22 @@ class CompilationEngine {
     ostream &output;
     Tokenizer tokenizer;
     SymbolTable &sTable;
-    VMWriter vm;
+    const ClassIndex &index;
+    ThreadPool *pool;                           /* compiles the subroutines of a class side by side, nullptr: one after another */
+    set<string> consumed;                       /* other classes whose signatures were looked up */
+    vector<CompileError> errors;                /* collected while recovering, thrown together at the end of the class */
+    VMFormat format;
+    unique_ptr<VMWriter> writer;
+    VMWriter &vm;
+    bool instrumented = false;                  /* count calls, loop iterations and branches, see writeCounter() */
+    const Profile *profile = nullptr;           /* lays out hot ifs and loops, see compileIf() and compileWhile() */
+    const SubroutineProfile *hot = nullptr;     /* profile of the subroutine being compiled, nullptr if none applies */
+    string subroutineName;
+    size_t nLoops = 0;                          /* while statements of the subroutine so far */
+    size_t nIfs = 0;                            /* if statements of the subroutine so far */
+    vector<string> counters;                    /* dump line of every counter, the counters follow the class's statics */
+    vector<string> hashes;                      /* hash line of every instrumented subroutine, see Profile */
+    function<void()> subroutineDone;            /* see onSubroutineDone() */
 
     const size_t INDENTSIZE = 2;
     
@@ -40,15 +62,49 @@ class CompilationEngine {
     bool isOp(char s);                          /* check if symbol s is a binary operator */
     bool isUnaryOp(char s);                     /* check if symbol s is a unary operator */
 
+    [[noreturn]] void error(const string &message);     /* throw a CompileError at the current line */
+    bool isStatementKeyword();
+    bool isSubroutineKeyword();
+    void synchronizeStatement(size_t start);            /* error recovery, start is where the broken statement began */
+    void synchronizeDeclaration(size_t start, bool classVarDec);
+
     string keywordToStr(Keyword key);
     string generateLabel();
+    void writeString(const string &str);       /* a new String with the text, left on the stack */
+
+    /* instrumented code: every counter is a pair of statics after the class's own, incremented in place,
+     * the dump function prints them one per line ("function Main.fib 1234", "loop Main.main 0 200"),
+     * Main.main calls the dump of every class in the index before it returns */
+    void writeCounter(const string &line);
+    void writeCounterDump();
+    /* skip the block at the current token, counting the ifs and whiles in it, false if it doesn't close */
+    bool skipBlock(size_t &ifs, size_t &whiles);
+
+    /* compile each subroutine on its own engine and splice the results in source order, false
+     * (with nothing written) when the class can't be split or has errors, the serial path takes over then */
+    bool compileSubroutinesInParallel();
 
     CompilationEngine() = delete;
+    CompilationEngine(Tokenizer &&part, ostream &outvm, ostream &outxml, SymbolTable &st, const ClassIndex &ci, VMFormat vmFormat)
+        : output{outxml}, tokenizer{move(part)}, sTable {st}, index {ci}, pool {nullptr},
+          format {vmFormat}, writer {VMWriter::create(outvm, vmFormat)}, vm {*writer} {}
 public:
-    CompilationEngine(istream &in, ostream &outvm, ostream &outxml, SymbolTable &st)
-        : output{outxml}, tokenizer{in}, sTable {st}, vm{outvm} {}
+    CompilationEngine(istream &in, ostream &outvm, ostream &outxml, SymbolTable &st, const ClassIndex &ci,
+                      ThreadPool *subroutinePool = nullptr, VMFormat vmFormat = VMFormat::TEXT, bool instrument = false,
+                      const Profile *executionProfile = nullptr, bool pipelinedLexer = false)
+        : output{outxml}, tokenizer{in, pipelinedLexer}, sTable {st}, index {ci}, pool {subroutinePool},
+          format {vmFormat}, writer {VMWriter::create(outvm, vmFormat)}, vm {*writer}, instrumented {instrument},
+          profile {executionProfile} {}
 
-    void compileClass();
+    inline static const string COUNTER_DUMP = "$counters";     /* Class.$counters, can't clash with a Jack name */
+    inline static const int COUNTER_BASE = 10000;              /* a counter is two statics, high * COUNTER_BASE + low */
+    inline static const uint64_t UNROLL_MIN_ITERATIONS = 4;    /* per call of the subroutine, to unroll a loop once */
+    inline static const size_t UNROLL_MAX_TOKENS = 128;        /* of the condition and body */
+
+    /* once each subroutine is compiled, as long as the class has no errors, its code is flushed to
+     * the vm stream and callback runs, not with parallel subroutines which are written all at once */
+    void onSubroutineDone(function<void()> callback) { subroutineDone = move(callback); }
+    void compileClass();                        /* throws CompileErrors with every error found in the class */
     void compileClassVarDec();
     void compileSubroutineDec();
     void compileParameterList();              /* returns the number of parameter in the list */
@@ -63,6 +119,8 @@ public:
     void compileExpression();
     void compileTerm();
     size_t compileExpressionList();             /* returns the number of expression */
+
+    const set<string> &consumedClasses() const { return consumed; }
 };
 
 #endif
@@ -0,0 +1,56 @@
+#ifndef _COMPILEERROR_HPP_
+#define _COMPILEERROR_HPP_
+
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* an error in the jack code, at a line of the source (0 when unknown) */
+class CompileError : public runtime_error {
+    string msg;
+    size_t lineNumber;
+public:
+    CompileError(const string &message, size_t line = 0)
+        : runtime_error {line ? "line " + to_string(line) + ": " + message : message}, msg {message}, lineNumber {line} {}
+
+    const string &message() const { return msg; }
+    size_t line() const { return lineNumber; }
+};
+
+/* every error found in one class, thrown once the whole class has been compiled */
+class CompileErrors : public runtime_error {
+    vector<CompileError> list;
+
+    static string join(const vector<CompileError> &errors) {
+        string joined;
+        for (const auto &error : errors) {
+            joined += (joined.empty() ? "" : "\n") + string(error.what());
+        }
+        return joined;
+    }
+public:
+    CompileErrors(const vector<CompileError> &errors) : runtime_error {join(errors)}, list {errors} {}
+
+    const vector<CompileError> &errors() const { return list; }
+};
+
+/* message of the exception currently being handled, call from a catch block, errors come in a few flavours */
+inline string currentErrorMessage() {
+    try {
+        throw;
+    } catch (exception &e) {
+        return e.what();
+    } catch (const char *e) {
+        return e;
+    } catch (string &e) {
+        return e;
+    } catch (...) {
+        return "Unknown error";
+    }
+}
+
+#endif
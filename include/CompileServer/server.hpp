@@ -0,0 +1,40 @@
+#ifndef _COMPILESERVER_HPP_
+#define _COMPILESERVER_HPP_
+
+#include <string>
+
+using namespace std;
+
+
+/*
+ *  Resident compiler process listening on a unix domain socket.
+ *  Keeping the process alive keeps the tokenizer tables, the thread pool,
+ *  class summaries and compiled classes warm between requests.
+ *
+ *  One request per connection, a header line optionally followed by a payload:
+ *      COMPILE "<path>" [options]\n    compile a file or directory like `jackc <path> [options]`
+ *      SOURCE <size> [options]\n<size bytes of jack source>
+ *                                      compile a class held in memory, the reply payload is the vm code
+ *      SHUTDOWN\n                      stop the server
+ *  The reply is "OK <size>\n" or "ERROR <size>\n" followed by <size> bytes of output.
+ *  A request with a malformed or oversized header or payload only gets an ERROR.
+ *  Requests are served one at a time, a client that stalls for IDLE_SECONDS
+ *  while sending its request or taking the reply is dropped so it can't hold
+ *  up the others.
+ */
+class CompileServer {
+    inline static const size_t MAX_HEADER = 64 * 1024;
+    inline static const size_t MAX_PAYLOAD = 64 * 1024 * 1024;
+    inline static const int IDLE_SECONDS = 10;
+    inline static const size_t READ_SIZE = 64 * 1024;
+
+    /* false if the connection broke, problem is set for a request that can't be served */
+    static bool readRequest(int fd, string &header, string &payload, string &problem);
+    static bool handle(int fd);                                                 /* false once asked to shut down */
+    static bool sendAll(int fd, const string &data);
+public:
+    static int serve(const string &socketPath);                                 /* run until SHUTDOWN */
+    static int forward(const string &socketPath, const string &header, const string &payload = "");  /* client side */
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef _FILEWATCHER_HPP_
+#define _FILEWATCHER_HPP_
+
+#include <filesystem>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+/*
+ *  inotify watch on a directory, reports .jack files that were written,
+ *  created, moved in, deleted or moved out.
+ *  Editors tend to produce a burst of events per save, they are drained
+ *  and deduplicated so every file is reported once per wait().
+ *  When the kernel's event queue overflows, events are lost and wait()
+ *  returns with overflowed() set, the caller has to rescan the directory.
+ */
+class FileWatcher {
+    fs::path dir;
+    int fd = -1;
+    bool lost = false;                              /* the queue overflowed during the last wait() */
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+public:
+    FileWatcher(const fs::path &watchedDir);
+    ~FileWatcher();
+
+    bool ok() const { return fd >= 0; }
+    vector<fs::path> wait();                        /* block until some .jack file changes, empty on error */
+    bool overflowed() const { return lost; }
+};
+
+#endif
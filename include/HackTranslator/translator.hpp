@@ -0,0 +1,62 @@
+#ifndef _HACKTRANSLATOR_HPP_
+#define _HACKTRANSLATOR_HPP_
+
+#include <VMProgram/program.hpp>
+#include <VMWriter/writer.hpp>
+#include <set>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+
+/*
+ *  Lowers VM programs straight to Hack assembly, one .asm for a whole program.
+ *  Working on the recorded program instead of one command at a time allows:
+ *    - the top of the stack lives in D, it only goes to memory before a label,
+ *      a jump or a call, so "push x, pop y" or "push x, push 1, add" never touch the stack
+ *    - a binary operation takes a constant or directly addressable operand
+ *      straight from its address instead of pushing it first
+ *    - a comparison followed by an if-goto (or not and an if-goto) is a single
+ *      conditional jump on x - y. gt and lt of two variables go through a shared
+ *      routine first, x - y overflows when their signs differ
+ *    - segment accesses with small indices step A instead of adding the index
+ *    - calls and returns go through shared trampolines, a call site is 7
+ *      instructions and a return 2. The callee's return value comes back in D.
+ */
+class HackTranslator {
+    string out;
+    size_t nInstructions = 0;
+    string fileName;                                /* statics of the file being translated are fileName.i */
+    string function;                                /* labels are scoped to the current function */
+    bool cached = false;                            /* the top of the stack is in D, SP points past the rest */
+    size_t uniq = 0;                                /* for labels the translator makes up */
+    set<uint32_t> callArities;                      /* a call trampoline is emitted for each */
+    bool compares = false;                          /* the $COMPARE routine is needed */
+
+    void emit(string_view instruction);
+    void emitLabel(string_view label);
+    void spill();                                   /* D to the stack if it holds the top */
+    void load();                                    /* the top of the stack into D */
+    bool selectAddress(Segment segment, uint32_t index, uint32_t maxSteps);   /* A = address without touching D */
+    void pushToD(Segment segment, uint32_t index);
+    void popFromD(Segment segment, uint32_t index);
+    bool binaryWithOperand(const Instruction &operand, Command command);
+    void compare();                                 /* D = sign of R13 - R14 without overflow */
+    size_t finishCompare(const vector<Instruction> &code, size_t k, Command command, const VMProgram &program);
+    void call(const string &name, uint32_t nArgs);
+    string scoped(const string &label) const;
+
+    HackTranslator(const HackTranslator &) = delete;
+    HackTranslator &operator=(const HackTranslator &) = delete;
+public:
+    inline static const size_t ROM_SIZE = 32 * 1024;
+
+    HackTranslator();                               /* starts with the bootstrap: SP = 256, call Sys.init */
+
+    void translate(const VMProgram &program, const string &fileName);   /* one .vm file, fileName without extension */
+    string finish();                                /* the trampolines are appended, returns the assembly */
+    size_t size() const { return nInstructions; }  /* ROM words so far */
+};
+
+#endif
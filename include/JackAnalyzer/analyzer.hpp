@@ -1,22 +1,69 @@
 #ifndef _ANALYZER_HPP_
 #define _ANALYZER_HPP_
 
-#include <SymbolTable/table.hpp>
+#include <AsyncIO/io.hpp>
+#include <ClassIndex/index.hpp>
+#include <Profile/profile.hpp>
+#include <ThreadPool/pool.hpp>
+#include <VMWriter/writer.hpp>
 #include <filesystem>
+#include <iostream>
+#include <set>
 #include <string>
+#include <vector>
 
 using namespace std;
 namespace fs = filesystem;
 
 
 class JackAnalyzer {
-    static void analyzeFile(const fs::path &file);
-    static void analyzeDir(const fs::path &dir);
+    /* compile one class in its own context (symbol table, tokenizer, writer) into outputvm, safe to run concurrently,
+     * returns the other classes whose interfaces the compile consumed, throws CompileErrors on failure */
+    static set<string> analyzeFile(const string &source, string &outputvm, const ClassIndex &index, ostream &outxml);
+    static void removeOutput(const fs::path &outputvm);    /* queued behind the pending writes */
+    /* false if any file failed, a non-empty program (a path without extension) is also linked, see link() */
+    static bool analyzeFiles(vector<fs::path> files, const fs::path &defaultCacheDir, const fs::path &program = {});
+    /* the compiled classes and the other .vm files next to them (e.g. the OS) as one program.asm and/or program.c,
+     * or run right away, false if the program can't be linked or run ends in an error */
+    static bool link(const vector<fs::path> &files, const vector<string> &outputs, const fs::path &program);
+    static ThreadPool &pool();                          /* shared by every compile of the process */
+    static AsyncIO &io();                               /* reads sources and writes outputs for every compile */
+    static const Profile *profiled() { return profile.empty() ? nullptr : &profile; }
 public:
+    inline static const string VERSION = "1.1.0";
+
     inline static bool printXml = false;
-    inline static SymbolTable table;
+    inline static bool useCache = false;
+    inline static bool parallelSubroutines = false;     /* compile the subroutines of a class side by side */
+    inline static bool pipelinedLexer = false;          /* lex large sources on a thread of their own, see Tokenizer */
+    inline static bool keepResident = false;            /* keep cache entries and class summaries in memory between compiles */
+    inline static VMFormat vmFormat = VMFormat::TEXT;   /* BINARY: .vmb bytecode instead of .vm text */
+    inline static bool emitAsm = false;                 /* also write the program as Hack assembly */
+    inline static bool emitC = false;                   /* also write the program as C, see runtime/ */
+    inline static bool instrument = false;              /* count calls, loop iterations and branches, dumped when Main.main returns */
+    inline static Profile profile;                      /* execution counts code is laid out by, see --profile */
+    inline static bool runProgram = false;              /* run the program in the VM interpreter after compiling */
+    inline static fs::path cacheDir;                    /* empty: .jackc-cache next to the sources */
+    inline static ostream *console = &cout;             /* where xml, reports and status lines go */
+    inline static ostream *diagnostics = &cerr;         /* where errors and warnings go, stdout keeps only the output */
 
+    static string optionsKey();                         /* everything that changes the generated code, salts the cache key */
     static bool analyze(string arg);
+    static void compileSource(const string &source, ostream &outvm);     /* compile a class held in memory */
+    /* compile the classes of a stream one after another as soon as each is complete, vm code goes
+     * to out subroutine by subroutine until a class has an error, the rest of that class is dropped,
+     * returns false if any class failed (errors go to cerr) */
+    static bool compileStream(istream &in, ostream &out);
+    static int watch(string arg);                       /* compile a directory, then recompile what changes until killed */
+    static int dump(string file);                       /* print the .vm text of a .vmb file */
+
+    /*
+     *  compile every project listed in a manifest in this one process, one project per line:
+     *      <project dir>                           compile the .jack files of the directory in place
+     *      <output dir>: <file.jack> ...           compile the listed files together, .vm files go to output dir
+     *  relative paths are relative to the manifest, blank lines and lines starting with # are skipped
+     */
+    static int batch(string manifest);
 };
 
 #endif
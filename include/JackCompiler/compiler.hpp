@@ -0,0 +1,59 @@
+#ifndef _JACKCOMPILER_HPP_
+#define _JACKCOMPILER_HPP_
+
+#include <Profile/profile.hpp>
+#include <ThreadPool/pool.hpp>
+#include <VMWriter/writer.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/*
+ *  In-memory compiler API, the core of libjackc.
+ *  Sources go in as buffers and VM code comes out as buffers, nothing touches
+ *  the filesystem or the console and every setting comes from CompileOptions,
+ *  so several threads may compile at the same time. The only process-wide
+ *  switches read are those of TimeReport and AllocationCounter, off unless
+ *  the host turns them on. Errors are reported as diagnostics, never thrown.
+ *
+ *  Link with build/apps/libjackc.a and include <JackCompiler/compiler.hpp>.
+ */
+
+typedef struct source_struct {
+    string name;                                    /* used in diagnostics, e.g. "Main.jack" */
+    string code;
+} Source;
+
+typedef struct diagnostic_struct {
+    string file;
+    size_t line;                                    /* 0 when unknown */
+    string message;
+} Diagnostic;
+
+typedef struct compile_options_struct {
+    bool xml = false;                               /* also produce the parse tree as xml */
+    ThreadPool *pool = nullptr;                     /* compile the sources on this pool, on the calling thread if null */
+    bool parallelSubroutines = false;               /* also spread the subroutines of each class over the pool */
+    VMFormat format = VMFormat::TEXT;               /* vm holds .vmb bytecode when BINARY */
+    bool instrument = false;                        /* counters for calls, loop iterations and branches */
+    const Profile *profile = nullptr;               /* lay out hot branches and loops as this profile says */
+    bool pipelinedLexer = false;                    /* lex large sources on a thread of their own while parsing */
+} CompileOptions;
+
+typedef struct compile_result_struct {
+    bool ok = true;                                 /* no diagnostics, every error of every source is reported */
+    vector<string> vm;                              /* VM code of each source, in input order */
+    vector<string> xml;                             /* parse tree of each source, when requested */
+    vector<Diagnostic> diagnostics;
+} CompileResult;
+
+class JackCompiler {
+public:
+    /* compile a set of classes together, calls between them are checked against each other */
+    static CompileResult compile(const vector<Source> &sources, const CompileOptions &options = {});
+    static CompileResult compile(const Source &source, const CompileOptions &options = {});
+};
+
+#endif
@@ -1,8 +1,13 @@
 #ifndef _TOKENIZER_HPP_
 #define _TOKENIZER_HPP_
 
+#include <CompileError/error.hpp>
+#include <SpscQueue/queue.hpp>
 #include <fstream>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 #include <regex>
 #include <map>
@@ -21,31 +26,65 @@ enum class Keyword {
     WHILE, RETURN, TRUE, FALSE, kNULL, THIS
 };
 
+/* a token as found by the lexer: where it sits in the source */
+typedef struct token_record_struct {
+    size_t begin;
+    size_t size;
+    size_t line;
+} TokenRecord;
+
+/*
+ *  Splits a class into tokens and walks them for the parser.
+ *  Normally the whole source is lexed up front. Constructed pipelined, a large
+ *  source is lexed on a thread of its own that hands token records to the
+ *  parser through a single producer single consumer queue, the parser starts
+ *  on the first tokens while the rest of the file is still being lexed.
+ *  A lexical error then only surfaces in finish(). The lexer thread only
+ *  touches the heap allocated Pipeline, so a Tokenizer can be moved meanwhile.
+ */
 class Tokenizer {
-    vector<string> tokens;
+    typedef struct pipeline_struct {
+        string code;                            /* the source the records point into */
+        SpscQueue<TokenRecord, 1024> queue;
+        optional<CompileError> error;           /* set by the lexer before it closes the queue */
+        thread lexer;
+    } Pipeline;
+
+    vector<string> tokens;                      /* the tokens lexed so far */
+    vector<size_t> lines;                       /* source line of each token */
     size_t tokenCounter = 0;
+    unique_ptr<Pipeline> pipeline;
 
-    Tokenizer() = delete;
-    void splitIntoTokens(string &code);
-    void addToTokens(string &token);
-    void addToTokens(char c);
+    Tokenizer() = default;                      /* only for slices */
+    bool fetch(size_t index);                   /* make tokens[index] available, false past the last token */
 public:
     static const vector<string> KEYWORDLIST;
     static const string SYMBOLLIST;
     static const regex IDENTIFIERREGEX;
     static const boost::bimap<string, Keyword> KEYWORDMAPPING;
 
-    Tokenizer(istream &input);
+    static const size_t PIPELINE_MIN_SIZE;      /* below this a lexer thread costs more than it saves */
+
+    Tokenizer(istream &input, bool pipelined = false);     /* pipelined: lex a large source on a thread of its own */
+    Tokenizer(Tokenizer &&) = default;
+    ~Tokenizer();
+    void finish();                              /* wait for the whole source to be lexed, throws its lexical error */
+    Tokenizer slice(size_t begin, size_t end) const;    /* a tokenizer over tokens [begin, end) only, after finish() */
     
     bool hasMoreTokens();
+    bool atEnd();                               /* advanced past the last token */
     void advance();
     void backtrack();
+    size_t position() { return tokenCounter; }
+    void seek(size_t position) { tokenCounter = position; }
+    size_t size() const { return tokens.size(); }     /* tokens lexed so far, all of them after finish() */
     Token tokenType();
     Keyword keyWord();
     char symbol();
     string identifier();
     int intVal();
     string stringVal();
+    size_t line();                              /* source line of the current token */
 
     void writeOutput(ostream &output); /* write to an xml file */
 };
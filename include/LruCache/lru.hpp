@@ -0,0 +1,55 @@
+#ifndef _LRUCACHE_HPP_
+#define _LRUCACHE_HPP_
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+
+/*
+ *  Map holding at most CAPACITY entries, inserting into a full map drops the
+ *  entry used least recently. Keeps resident processes (the compile server)
+ *  from growing with every source they ever saw.
+ *  Not synchronized, callers hold their own lock.
+ */
+template <typename Key, typename Value, size_t CAPACITY>
+class LruCache {
+    static_assert(CAPACITY > 0, "an LRU cache holds at least one entry");
+
+    typedef list<pair<Key, Value>> Entries;
+    Entries entries;                                /* most recently used first */
+    unordered_map<Key, typename Entries::iterator> positions;
+public:
+    /* nullptr on a miss, a hit becomes the most recently used entry */
+    const Value *find(const Key &key) {
+        auto result = positions.find(key);
+        if (result == positions.end()) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, result->second);
+        return &result->second->second;
+    }
+
+    void insert(const Key &key, Value value) {
+        auto result = positions.find(key);
+        if (result != positions.end()) {
+            result->second->second = move(value);
+            entries.splice(entries.begin(), entries, result->second);
+            return;
+        }
+
+        entries.emplace_front(key, move(value));
+        positions[key] = entries.begin();
+        if (entries.size() > CAPACITY) {
+            positions.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    size_t size() const { return entries.size(); }
+};
+
+#endif
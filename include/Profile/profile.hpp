@@ -0,0 +1,55 @@
+#ifndef _PROFILE_HPP_
+#define _PROFILE_HPP_
+
+#include <ClassIndex/index.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+typedef struct subroutine_profile_struct {
+    uint64_t bodyHash = 0;                          /* of the body the counts were recorded on */
+    bool hashed = false;                            /* a hash line was seen */
+    bool conflicting = false;                       /* runs of different versions were mixed */
+    uint64_t calls = 0;
+    map<size_t, uint64_t> loops;                    /* while number -> iterations */
+    map<size_t, pair<uint64_t, uint64_t>> branches; /* if number -> times the then branch ran, times it didn't */
+} SubroutineProfile;
+
+/*
+ *  Execution counts the compiler lays code out by, what an --instrument build
+ *  prints when Main.main returns, one record per line:
+ *      hash <Class.subroutine> <hex>           body hash (see ClassIndex) the counts below belong to
+ *      function <Class.subroutine> <calls>
+ *      loop <Class.subroutine> <n> <count>     iterations of the n-th while of the subroutine, in source order
+ *      then <Class.subroutine> <n> <count>     times the then branch of the n-th if ran
+ *      else <Class.subroutine> <n> <count>     times it didn't, with or without an else branch
+ *  Any other line (the program's own output) is skipped, so the output of a
+ *  run is a profile as it is; the counts of several runs add up.
+ *  A subroutine is stale, and has no profile, when its hash is missing or no
+ *  longer matches the body being compiled.
+ */
+class Profile {
+    unordered_map<string, SubroutineProfile> subroutines;
+    uint64_t contentHash = 0;
+public:
+    static bool read(const fs::path &file, Profile &profile);     /* false if the file can't be read */
+    void parse(istream &in);
+    bool empty() const { return subroutines.empty(); }
+    uint64_t digest() const { return contentHash; }                /* salts the cache key */
+
+    /* nullptr unless the subroutine was profiled on this very body */
+    const SubroutineProfile *find(const string &name, uint64_t bodyHash) const;
+    /* profiled subroutines of indexed classes whose profile doesn't apply to their current body */
+    vector<string> stale(const ClassIndex &index) const;
+};
+
+#endif
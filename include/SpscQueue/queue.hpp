@@ -0,0 +1,86 @@
+#ifndef _SPSCQUEUE_HPP_
+#define _SPSCQUEUE_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+
+/*
+ *  Lock-free bounded queue between exactly one producer and one consumer thread.
+ *  The producer owns tail and the consumer owns head, each side only reads the
+ *  other's index, so a push or pop is a plain store plus one release.
+ *  Pushed items are published PUBLISH_BATCH at a time (or when the queue fills
+ *  up), a waiting consumer is woken once per batch instead of once per item.
+ *  A side that has to wait (full or empty queue) sleeps on the other's index
+ *  with atomic wait, the top bit of an index carries "closed" (producer is
+ *  done) or "cancelled" (consumer gave up) so that wakes the sleeper as well.
+ */
+template <typename T, size_t CAPACITY, size_t PUBLISH_BATCH = 32>
+class SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+    static_assert(PUBLISH_BATCH > 0 && PUBLISH_BATCH <= CAPACITY, "a batch has to fit the queue");
+
+    static constexpr size_t STOP_BIT = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+    alignas(64) atomic<size_t> head {0};            /* next slot to pop, written by the consumer */
+    alignas(64) atomic<size_t> tail {0};            /* end of the published items, written by the producer */
+    size_t written = 0;                             /* end of the items pushed, producer only */
+    alignas(64) array<T, CAPACITY> slots;
+
+    void publish(size_t flags = 0) {
+        tail.store(written | flags, memory_order_release);
+        tail.notify_one();
+    }
+public:
+    /* producer: false once the consumer cancelled, the item is dropped then */
+    bool push(const T &item) {
+        while (true) {
+            size_t consumed = head.load(memory_order_acquire);
+            if (consumed & STOP_BIT) return false;
+            if (written - consumed < CAPACITY) break;
+
+            // full, whatever is still unpublished has to reach the consumer first
+            publish();
+            head.wait(consumed, memory_order_acquire);
+        }
+
+        slots[written & (CAPACITY - 1)] = item;
+        written++;
+        if (written - (tail.load(memory_order_relaxed) & ~STOP_BIT) >= PUBLISH_BATCH) {
+            publish();
+        }
+        return true;
+    }
+
+    /* producer: no more items, pop drains what is left and then fails */
+    void close() {
+        publish(STOP_BIT);
+    }
+
+    /* consumer: waits for an item, false once the queue is closed and empty */
+    bool pop(T &item) {
+        size_t position = head.load(memory_order_relaxed);
+        while (true) {
+            size_t produced = tail.load(memory_order_acquire);
+            if (position != (produced & ~STOP_BIT)) break;
+            if (produced & STOP_BIT) return false;
+            tail.wait(produced, memory_order_acquire);
+        }
+
+        item = slots[position & (CAPACITY - 1)];
+        head.store(position + 1, memory_order_release);
+        head.notify_one();
+        return true;
+    }
+
+    /* consumer: stop taking items, a producer waiting for room gives up */
+    void cancel() {
+        head.fetch_or(STOP_BIT, memory_order_release);
+        head.notify_one();
+    }
+};
+
+#endif
@@ -2,27 +2,75 @@
 #define _SYMBOLTABLE_HPP_
 
 #include <SymbolTable/var.hpp>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
 
+/* lightweight handle returned by SymbolTable::resolve, evaluates to false for an undefined name,
+ * type stays valid as long as the table, whatever is defined after */
+struct Symbol {
+    string_view type;
+    Kind kind = Kind::VAR;
+    Segment segment = Segment::LOCAL;
+    size_t index = 0;
+    bool defined = false;
+
+    explicit operator bool() const { return defined; }
+};
+
+/* hash that lets the scope index be probed with a string_view without building a string */
+struct NameHash {
+    using is_transparent = void;
+    size_t operator()(string_view name) const { return hash<string_view>{}(name); }
+};
+
+/*
+ *  A scope keeps its entries in declaration order in a flat vector.
+ *  Subroutine scopes are almost always tiny, so a linear scan over
+ *  contiguous memory beats hashing; once a scope grows past LINEAR_LIMIT
+ *  entries (big generated classes) a hash index over the vector is built
+ *  and kept up to date.
+ */
+class Scope {
+    vector<pair<string, Var>> entries;
+    unordered_map<string, size_t, NameHash, equal_to<>> index;            /* name -> position in entries, only used past LINEAR_LIMIT */
+
+    inline static const size_t LINEAR_LIMIT = 32;
+public:
+    const Var *find(string_view name) const;
+    bool insert(const string &name, const Var &var);   /* returns false if name is already defined */
+    void clear();
+
+    vector<pair<string, Var>>::const_iterator begin() const { return entries.begin(); }
+    vector<pair<string, Var>>::const_iterator end() const { return entries.end(); }
+};
+
 class SymbolTable {
-    unordered_map <string, Var> classTable;
-    unordered_map <string, Var> subroutineTable;
+    Scope staticTable;
+    Scope fieldTable;
+    Scope subroutineTable;
+    size_t counts[4] = {0, 0, 0, 0};                /* running number of variables, indexed by Kind */
+    unordered_set<string> typeNames;                /* every type ever defined, nodes never move */
 
-    Var *find(string name);
+    const Var *find(string_view name) const;
+    Scope &scopeOf(Kind kind);
 public:
     SymbolTable();
-    
+    SymbolTable(const SymbolTable &other);          /* the copy interns its own types */
+    SymbolTable &operator=(const SymbolTable &) = delete;
+
     void startSubroutine();
-    void startClass();                                  /* clear the class table of field, leaving only static variables */
+    void startClass();                                  /* clear statics and fields, every class starts from index 0 */
     void define(string name, string type, Kind kind);
     size_t varCount(Kind kind);
 
-    Kind *kindOf(string name);
-    string *typeOf(string name);
-    size_t *indexOf(string name);
+    Symbol resolve(string_view name) const;          /* type, kind, segment and index of name in one probe */
 
     /* Used for testing */
     void printClassTable();
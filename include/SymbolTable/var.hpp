@@ -1,7 +1,9 @@
 #ifndef _VAR_HPP_
 #define _VAR_HPP_
 
+#include <VMWriter/segment.hpp>
 #include <string>
+#include <string_view>
 
 using namespace std;
 
@@ -11,8 +13,9 @@ enum class Kind {
 };
 
 typedef struct var_struct {
-    string type;
+    string_view type;                               /* interned by the SymbolTable */
     Kind kind;
+    Segment segment;                                /* where the kind lives in the VM */
     size_t index;
 } Var;
 
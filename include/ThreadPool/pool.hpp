@@ -0,0 +1,54 @@
+#ifndef _THREADPOOL_HPP_
+#define _THREADPOOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+/*
+ *  Work-stealing thread pool.
+ *  Every worker owns a deque of tasks, it takes work from the back of its own
+ *  deque and, once that is empty, steals from the front of the other workers'.
+ *  A thread waiting in parallelFor doesn't sit idle either, it runs queued
+ *  tasks until its own batch is done, so nested or single-core use can't stall.
+ */
+class ThreadPool {
+    typedef struct worker_struct {
+        mutex lock;
+        deque<function<void()>> tasks;
+    } Worker;
+
+    vector<unique_ptr<Worker>> workers;
+    vector<thread> threads;
+
+    mutex idleLock;
+    condition_variable wakeUp;                      /* signalled when a task is queued or the pool stops */
+    size_t queued = 0;                              /* tasks sitting in the deques, guarded by idleLock */
+    size_t nextWorker = 0;                          /* round robin target for submit, guarded by idleLock */
+    bool stopping = false;
+
+    bool tryPop(size_t self, function<void()> &task);
+    void run(size_t self);
+    void submit(function<void()> task);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+public:
+    ThreadPool(size_t nThreads = thread::hardware_concurrency());
+    ~ThreadPool();
+
+    size_t size() const { return threads.size(); }
+
+    /* run body(0) ... body(n - 1) on the pool and return once all of them finished,
+     * if any of them threw, the exception of the lowest index is rethrown */
+    void parallelFor(size_t n, const function<void(size_t)> &body);
+};
+
+#endif
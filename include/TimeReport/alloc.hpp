@@ -0,0 +1,51 @@
+#ifndef _ALLOC_HPP_
+#define _ALLOC_HPP_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+typedef struct allocation_site_struct {
+    string function;                                /* first caller outside the standard library */
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+} AllocationSite;
+
+/*
+ *  --alloc-report: the global operator new is replaced by one that, while
+ *  counting, charges every allocation to the phase of the thread's PhaseTimer
+ *  and to the file of its FileScope (see TimeReport), and records its call
+ *  stack so allocations can be summed per calling function. The stacks are
+ *  unwound on every allocation, counting is for measuring, not for builds.
+ *  Not counting, the replacement is malloc behind one test.
+ *  The replacement (TimeReport/new.cpp) is linked into the executable only,
+ *  a program using libjackc.a keeps its own allocator and counts nothing.
+ */
+class AllocationCounter {
+public:
+    inline static atomic<bool> counting = false;
+    inline static bool json = false;                /* --alloc-report=json, the merged report is JSON if either asks */
+
+    static void count(size_t size);                 /* charge an allocation, called by the replaced operator new */
+    static uint64_t calls(size_t phase);            /* phase as in TimeReport::phase() */
+    static uint64_t bytes(size_t phase);
+    static vector<AllocationSite> sites(size_t top);     /* the top functions by calls */
+    static uint64_t peakRssKb();                    /* of the process so far */
+
+    /*
+     *  Peak resident memory since resetPeakRss(), from the kernel's high-water
+     *  mark (VmHWM, reset through /proc/self/clear_refs). The mark is the
+     *  process's: files compiled at the same time all move it, and each reset
+     *  lowers it for the files still running. Where it can't be reset this is
+     *  the peak of the process so far.
+     */
+    static void resetPeakRss();
+    static uint64_t peakRssSinceResetKb();
+    static void reset();
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _TIMEREPORT_HPP_
+#define _TIMEREPORT_HPP_
+
+#include <TimeReport/alloc.hpp>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+
+enum class Phase {
+    READ, INDEX, CACHE, LEX, PARSE, SYMBOLS, WRITE, LINK
+};
+
+typedef struct phase_times_struct {
+    inline static const size_t PHASES = size_t(Phase::LINK) + 1;
+
+    uint64_t nanoseconds[PHASES] = {};
+    uint64_t bytes = 0;                             /* of the source */
+    uint64_t lines = 0;
+    uint64_t tokens = 0;
+    uint64_t instructions = 0;                      /* VM instructions emitted */
+    uint64_t allocations = 0;                       /* see AllocationCounter */
+    uint64_t allocatedBytes = 0;
+    uint64_t peakRssKb = 0;                         /* of the process while the file compiled, see AllocationCounter */
+} PhaseTimes;
+
+/*
+ *  --time-report: where a compile spends its time.
+ *  A PhaseTimer charges the time from its construction to its destruction to
+ *  one phase, exclusively: a timer started inside another one (symbol table
+ *  lookups inside the parser) pauses the outer phase. Timers inside a FileScope
+ *  are charged to that file, the others (the batched read, waiting for the
+ *  writes, linking) to the compile as a whole.
+ *  Everything is per thread until a FileScope ends, and a disabled timer is a
+ *  single inlined test of active(), nothing is called. The same timers and scopes tell the allocation
+ *  counter (--alloc-report) which phase and file an allocation belongs to.
+ */
+class TimeReport {
+    map<string, PhaseTimes> files;
+    PhaseTimes overall;                             /* what no file scope covered */
+    mutex lock;
+
+    static TimeReport &shared();
+public:
+    inline static bool enabled = false;
+    inline static bool json = false;                /* --time-report=json, JSON instead of the tables */
+
+    /* timing or counting allocations */
+    static bool active() { return enabled || AllocationCounter::counting.load(memory_order_relaxed); }
+    static void charge(Phase phase, uint64_t nanoseconds);
+    static PhaseTimes *current();                   /* counts of the file the thread works on, nullptr outside a file */
+    static size_t phase();                          /* the thread's phase, PhaseTimes::PHASES outside all of them */
+    static void merge(const string &file, const PhaseTimes &times);
+
+    /* phases sorted by time (or allocations), then files sorted the same way, clears the report for the next compile */
+    static void print(ostream &out);
+};
+
+class PhaseTimer {
+    bool on;
+    Phase previous;
+    bool nested;
+
+    void start(Phase phase);
+    void stop();
+public:
+    PhaseTimer(Phase phase) : on {TimeReport::active()} { if (on) start(phase); }
+    ~PhaseTimer() { if (on) stop(); }
+
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+};
+
+/* the timers and counts of this thread belong to file until the scope ends */
+class FileScope {
+    bool on;
+    string file;
+    PhaseTimes times;
+    PhaseTimes *outer;
+public:
+    FileScope(const string &fileName);
+    ~FileScope();
+
+    FileScope(const FileScope &) = delete;
+    FileScope &operator=(const FileScope &) = delete;
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef _VMINTERPRETER_HPP_
+#define _VMINTERPRETER_HPP_
+
+#include <VMProgram/program.hpp>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/*
+ *  Runs VM programs headless, for regression tests of the compiled code.
+ *  load() pre-decodes every class into one array of compact operations:
+ *  labels and calls are resolved to indices, segments to a handler each,
+ *  statics to their RAM address, and common sequences are fused into
+ *  superinstructions (push constant; add, push local; add, a comparison with
+ *  a constant, a comparison and the if-goto after it, pop pointer 1; push that 0,
+ *  push constant; return). run() threads the array with computed gotos where
+ *  the compiler supports them (a switch otherwise).
+ *
+ *  Memory is the Hack RAM: the stack from 256, frames as the VM translator
+ *  lays them out, statics from 16, the heap from 2048 and the screen from 16384.
+ *  The OS classes the program doesn't define are native, with the same
+ *  behaviour as runtime/jackos.c: Output writes to out and Keyboard reads in.
+ */
+class VMInterpreter {
+    enum class Code : uint8_t {
+        PUSH_CONST, PUSH_LOCAL, PUSH_ARG, PUSH_THIS, PUSH_THAT, PUSH_POINTER0, PUSH_POINTER1, PUSH_RAM,
+        POP_LOCAL, POP_ARG, POP_THIS, POP_THAT, POP_POINTER0, POP_POINTER1, POP_RAM,
+        ADD, SUB, NEG, EQ, GT, LT, AND, OR, NOT,
+        GOTO, IF_GOTO, CALL, CALL_NATIVE, FUNCTION, RETURN, HALT,
+        ADD_CONST, SUB_CONST, ADD_LOCAL, ADD_ARG, EQ_CONST, GT_CONST, LT_CONST,
+        JUMP_EQ, JUMP_NE, JUMP_GT, JUMP_LE, JUMP_LT, JUMP_GE, JUMP_UNLESS_TRUE,
+        THAT_AT, RETURN_CONST
+    };
+
+    typedef struct op_struct {
+        const void *handler;                        /* threaded dispatch, filled in by run() */
+        Code code;
+        uint8_t weight;                             /* VM instructions the operation stands for */
+        int32_t a;                                  /* index, constant, address, jump target or callee */
+        int32_t b;                                  /* nArgs of a call */
+    } Op;
+
+    typedef int16_t (VMInterpreter::*Native)(const int16_t *args);
+
+    typedef struct call_fixup_struct {
+        size_t op;
+        string function;
+    } CallFixup;
+
+    vector<Op> code;
+    map<string, size_t> functions;                  /* entry of every function the program defines */
+    vector<CallFixup> calls;                        /* resolved by run(), once every class is loaded */
+    int nextStatic = 16;
+
+    vector<int16_t> ram;
+    ostream &out;
+    istream &in;
+    uint64_t nExecuted = 0;
+    int16_t freeList = 0;
+    int16_t color = -1;
+
+    static const map<string, Native> &natives();
+    vector<Native> nativeTable;                     /* operand of CALL_NATIVE */
+
+    void decodeFunction(const VMProgram &program, size_t begin, size_t end, int staticBase);
+
+    int16_t alloc(int16_t size);
+    void drawPixel(int x, int y);
+    void drawHorizontal(int x1, int x2, int y);
+    [[noreturn]] void error(int16_t code);
+
+    /* the OS, args as the VM passes them, the result replaces them */
+    int16_t sysHalt(const int16_t *args);
+    int16_t sysError(const int16_t *args);
+    int16_t sysWait(const int16_t *args);
+    int16_t memoryInit(const int16_t *args);
+    int16_t memoryPeek(const int16_t *args);
+    int16_t memoryPoke(const int16_t *args);
+    int16_t memoryAlloc(const int16_t *args);
+    int16_t memoryDeAlloc(const int16_t *args);
+    int16_t arrayNew(const int16_t *args);
+    int16_t nothing(const int16_t *args);
+    int16_t mathAbs(const int16_t *args);
+    int16_t mathMultiply(const int16_t *args);
+    int16_t mathDivide(const int16_t *args);
+    int16_t mathMin(const int16_t *args);
+    int16_t mathMax(const int16_t *args);
+    int16_t mathSqrt(const int16_t *args);
+    int16_t stringNew(const int16_t *args);
+    int16_t stringLength(const int16_t *args);
+    int16_t stringCharAt(const int16_t *args);
+    int16_t stringSetCharAt(const int16_t *args);
+    int16_t stringAppendChar(const int16_t *args);
+    int16_t stringEraseLastChar(const int16_t *args);
+    int16_t stringIntValue(const int16_t *args);
+    int16_t stringSetInt(const int16_t *args);
+    int16_t stringNewLine(const int16_t *args);
+    int16_t stringBackSpace(const int16_t *args);
+    int16_t stringDoubleQuote(const int16_t *args);
+    int16_t outputMoveCursor(const int16_t *args);
+    int16_t outputPrintChar(const int16_t *args);
+    int16_t outputPrintString(const int16_t *args);
+    int16_t outputPrintInt(const int16_t *args);
+    int16_t outputPrintln(const int16_t *args);
+    int16_t outputBackSpace(const int16_t *args);
+    int16_t screenInit(const int16_t *args);
+    int16_t screenClearScreen(const int16_t *args);
+    int16_t screenSetColor(const int16_t *args);
+    int16_t screenDrawPixel(const int16_t *args);
+    int16_t screenDrawLine(const int16_t *args);
+    int16_t screenDrawRectangle(const int16_t *args);
+    int16_t screenDrawCircle(const int16_t *args);
+    int16_t keyboardKeyPressed(const int16_t *args);
+    int16_t keyboardReadChar(const int16_t *args);
+    int16_t keyboardReadLine(const int16_t *args);
+    int16_t keyboardReadInt(const int16_t *args);
+
+    VMInterpreter(const VMInterpreter &) = delete;
+    VMInterpreter &operator=(const VMInterpreter &) = delete;
+public:
+    inline static const int STACK_BASE = 256;
+    inline static const int STACK_END = 2048;      /* the heap starts here */
+    inline static const int HEAP_END = 16384;
+
+    VMInterpreter(ostream &output = cout, istream &input = cin);
+
+    void load(const VMProgram &program, const string &fileName);     /* throws runtime_error on code it can't run */
+    /* Sys.init of the program, or Main.main after the native OS is initialized,
+     * returns the exit status: 0 when it halts or returns, 1 after Sys.error or a runtime error */
+    int run();
+    uint64_t executed() const { return nExecuted; }  /* VM instructions run */
+};
+
+#endif
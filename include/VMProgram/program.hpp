@@ -0,0 +1,61 @@
+#ifndef _VMPROGRAM_HPP_
+#define _VMPROGRAM_HPP_
+
+#include <VMWriter/writer.hpp>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+
+enum class Opcode : uint8_t {
+    PUSH, POP, ARITHMETIC, LABEL, GOTO, IF_GOTO, CALL, FUNCTION, RETURN
+};
+
+typedef struct instruction_struct {
+    Opcode opcode;
+    uint8_t kind;                                   /* Segment of a push or pop, Command of an arithmetic */
+    uint32_t operand;                               /* index, nArgs or nLocals */
+    uint32_t name;                                  /* label or function name, index into names */
+} Instruction;
+
+/*
+ *  VM code as data, what the binary backend records and what every tool
+ *  working on compiled code loads.
+ *  Label and function names are interned in names in order of first use.
+ *
+ *  Binary encoding (.vmb), all numbers are LEB128 varints:
+ *      "JVMB" version
+ *      nNames { length bytes }
+ *      nInstructions { instruction }
+ *  an instruction is one byte with the opcode in the high and the segment or
+ *  command in the low nibble, followed by its operands: push/pop index,
+ *  label/goto/if-goto name, call name nArgs, function name nLocals.
+ *  Several programs may follow each other in one file (stdin mode).
+ */
+class VMProgram {
+    unordered_map<string, uint32_t> nameIds;
+public:
+    inline static const char MAGIC[] = "JVMB";
+    inline static const uint8_t VERSION = 1;
+
+    vector<Instruction> code;
+    vector<string> names;
+
+    uint32_t intern(const string &name);
+    void add(Opcode opcode, uint8_t kind, uint32_t operand, uint32_t name = 0);
+    void append(const VMProgram &other);            /* names of other are interned into this program */
+    void clear();
+
+    void writeText(ostream &out) const;             /* exactly the text the text backend writes */
+    void writeBinary(ostream &out) const;
+    static bool readBinary(istream &in, VMProgram &program);      /* false at the end of the input or on bad data */
+    static bool readText(istream &in, VMProgram &program);        /* any .vm file, false on a malformed line */
+    static bool isBinary(string_view data);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _VMRECORDER_HPP_
+#define _VMRECORDER_HPP_
+
+#include <VMProgram/program.hpp>
+#include <VMWriter/writer.hpp>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/*
+ *  The binary backend: instead of text every instruction is recorded into a
+ *  VMProgram, and flush() writes the program in its binary encoding.
+ *  Headers work as in the text writer, they are recorded on the side and
+ *  spliced in at their slots on the way out.
+ */
+class VMRecorder : public VMWriter {
+    VMProgram program;                              /* the file so far, headers not yet spliced in */
+    vector<Instruction> headerCode;
+    vector<HeaderSlot> headers;                     /* positions are instruction counts here */
+    vector<Instruction> *output;
+
+    void record(Opcode opcode, uint8_t kind, int operand, const string *name = nullptr);
+public:
+    VMRecorder(ostream &out) : VMWriter(out, false), output {&program.code} {}
+    ~VMRecorder() { flush(); }
+
+    void reserveHeader() override;
+    void startHeader() override;
+    void endHeader() override;
+
+    void writePush(Segment segment, int index) override;
+    void writePop(Segment segment, int index) override;
+    void writeArithmetic(Command command) override;
+    void writeLabel(const string &label) override;
+    void writeGoto(const string &label) override;
+    void writeIf(const string &label) override;
+    void writeCall(const string &name, int nArgs) override;
+    void writeFunction(const string &name, int nLocals) override;
+    void writeReturn() override;
+
+    void writeCompiled(const string &code) override;
+    void flush() override;                          /* one binary program with everything recorded so far */
+};
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef _SEGMENT_HPP_
+#define _SEGMENT_HPP_
+
+
+/* VM memory segments, on their own so the SymbolTable can name them without the writer */
+enum class Segment {
+    CONST, ARG, LOCAL, STATIC, THIS, THAT, POINTER, TEMP
+};
+
+#endif
@@ -1,72 +1,93 @@
 #ifndef _VMWRITER_HPP_
 #define _VMWRITER_HPP_
 
-#include "SymbolTable/var.hpp"
+#include <VMWriter/segment.hpp>
 #include <fstream>
+#include <memory>
 #include <sstream>
+#include <string>
+#include <vector>
 
 using namespace std;
 
 
-enum class Segment {
-    CONST, ARG, LOCAL, STATIC, THIS, THAT, POINTER, TEMP
-};
-
 enum class Command {
     ADD, SUB, NEG, EQ, GT, LT, AND, OR, NOT
 };
 
-enum class Buffer {
-    STRING, FILE
-};
-
 ostream &operator<<(ostream &out, Segment seg);
 ostream &operator<<(ostream &out, Command cmd);
 Command charToCommand(char c);
-Segment kindToSegment(Kind k);
+
+enum class VMFormat {
+    TEXT, BINARY                                    /* .vm text or .vmb bytecode, see VMProgram */
+};
+
+/* where the header of a subroutine goes, its text sits in the header buffer until the flush */
+typedef struct header_slot_struct {
+    size_t position;                                /* offset in the file buffer */
+    size_t begin;                                   /* header text in the header buffer */
+    size_t end;
+} HeaderSlot;
 
 class VMWriter {
     /*
-     *  file buffer stream and string buffer stream is created
-     *  because when creating a function in jack vm language
-     *  we need to know the number of local variables, yet
-     *  there is no way to tell until we actually compile
-     *  the subroutine bode, therefore before compiling
-     *  the body, we switch to the string buffer, and write there
-     *  then after we finish that, we switch to the file buffer (the real output stream)
-     *  write the function declaration, and then call writeNow() to
-     *  get the string buffer stream and put it into the file buffer
+     *  when creating a function in jack vm language we need to know the
+     *  number of local variables, yet there is no way to tell until we
+     *  actually compile the subroutine body. So reserveHeader() marks the
+     *  spot in the file buffer and the body is written right there, then
+     *  startHeader() sends the function declaration to the header buffer
+     *  and endHeader() goes back to the file buffer.
+     *  The headers are only spliced in on the way to the stream, a body is
+     *  written once and never copied around afterwards.
      *
-     *  TLDR: put code for body in temporary var stringBuffer, output code for
-     *  function declaration, add stringBuffer after function declaration
+     *  Both buffers are plain strings that keep their capacity, instructions are
+     *  appended from precomputed text, and the file buffer goes out to the
+     *  stream in FLUSH_SIZE chunks (and on flush()), never once per line.
      */
-    ostream &fileBuffer;                            /* buffer for file, don't use this stream directly */
-    ostringstream stringBuffer;                     /* buffer for string, don't use this stream directly */
-    ostream *output;
+    string fileBuffer;                              /* buffer for file, don't use this directly */
+    string headerBuffer;                            /* headers of the subroutines in the file buffer */
+    vector<HeaderSlot> headers;
+    string *output;
     size_t uniq = 0;                                /* starting id for generating a unique id */
 
-    inline static const size_t INDENT_SIZE = 4;
+    inline static const size_t FLUSH_SIZE = 64 * 1024;
 
     VMWriter() = delete;
+    VMWriter(const VMWriter &) = delete;
+    VMWriter &operator=(const VMWriter &) = delete;
 
     size_t getUniq();                               /* generate a unique id */
+    void writeIndex(int index);                     /* index and the end of the line */
+    void flushIfFull();
+protected:
+    ostream &fileStream;                            /* where the code finally goes */
+
+    VMWriter(ostream &out, bool buffered) : output {&fileBuffer}, fileStream {out} { if (buffered) fileBuffer.reserve(FLUSH_SIZE); }
 public:
-    VMWriter(ostream &out) : fileBuffer {out}, output {&fileBuffer} {}
+    VMWriter(ostream &out) : VMWriter(out, true) {}
+    virtual ~VMWriter() { flush(); }
+
+    static unique_ptr<VMWriter> create(ostream &out, VMFormat format);
 
-    void switchBuffer(Buffer bf);
+    virtual void reserveHeader();                   /* a subroutine starts here, its body follows right away */
+    virtual void startHeader();                     /* the body is done, write the subroutine's header */
+    virtual void endHeader();                       /* back to the file after the header */
 
-    void writePush(Segment segment, int index);
-    void writePop(Segment segment, int index);
-    void writeArithmetic(Command command);
-    void writeLabel(string label);
-    void writeGoto(string label);
-    void writeIf(string label);
-    void writeCall(string name, int nArgs);
-    void writeFunction(string name, int nLocals);
-    void writeReturn();
+    virtual void writePush(Segment segment, int index);
+    virtual void writePop(Segment segment, int index);
+    virtual void writeArithmetic(Command command);
+    virtual void writeLabel(const string &label);
+    virtual void writeGoto(const string &label);
+    virtual void writeIf(const string &label);
+    virtual void writeCall(const string &name, int nArgs);
+    virtual void writeFunction(const string &name, int nLocals);
+    virtual void writeReturn();
 
-    void writeNow();                                /* write the content of string buffer to file buffer, and empty string buffer */
+    virtual void writeCompiled(const string &code); /* append code another writer of the same format generated */
+    virtual void flush();                           /* hand everything in the file buffer to the stream */
     string generateLabel();                         /* generate unique lable */
+    void startLabelsAt(size_t id);                  /* the next label generated gets this id */
 };
 
 #endif
@@ -0,0 +1,17 @@
+#ifndef _JACK_H_
+#define _JACK_H_
+
+#include <stdint.h>
+
+/*
+ *  What C generated by jackc --c needs from the runtime: the word type and the
+ *  Hack RAM, which holds the heap (objects and arrays) and the screen.
+ *  The stack, the segments and the statics of the program are C variables.
+ */
+typedef int16_t jack_word;
+
+extern jack_word jack_ram[32768];
+
+#define JACK_RAM(address) jack_ram[(uint16_t)(address) & 0x7fff]
+
+#endif
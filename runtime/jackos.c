@@ -0,0 +1,410 @@
+/*
+ *  The Jack OS for programs translated to C by jackc --c.
+ *  Output and Keyboard work on stdout and stdin instead of the screen and the
+ *  keyboard, so a test program prints its results as plain text; Screen still
+ *  draws into the screen memory map. Sys.wait returns at once and Sys.error
+ *  prints ERR<code> and exits with status 1.
+ *
+ *  Every function is weak: OS classes the program brings as .vm files replace
+ *  these, and the classes here call each other through the Jack names so they
+ *  use the replacements as well.
+ */
+#include "jack.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GNUC__)
+#define JACK_OS __attribute__((weak))
+#else
+#define JACK_OS
+#endif
+
+#define HEAP_BASE 2048
+#define HEAP_END 16384
+#define SCREEN 16384
+#define MAX_LINE 256
+
+jack_word jack_ram[32768];
+
+jack_word Main__main(void);
+
+jack_word Sys__halt(void);
+jack_word Sys__error(jack_word errorCode);
+jack_word Memory__init(void);
+jack_word Memory__alloc(jack_word size);
+jack_word Memory__deAlloc(jack_word o);
+jack_word Math__init(void);
+jack_word Math__abs(jack_word x);
+jack_word Screen__init(void);
+jack_word Screen__drawPixel(jack_word x, jack_word y);
+jack_word Output__init(void);
+jack_word Output__printChar(jack_word c);
+jack_word Output__printString(jack_word s);
+jack_word Keyboard__init(void);
+jack_word String__new(jack_word maxLength);
+jack_word String__dispose(jack_word this);
+jack_word String__length(jack_word this);
+jack_word String__charAt(jack_word this, jack_word j);
+jack_word String__appendChar(jack_word this, jack_word c);
+jack_word String__intValue(jack_word this);
+
+
+/* Sys */
+
+JACK_OS jack_word Sys__init(void) {
+    Memory__init();
+    Math__init();
+    Screen__init();
+    Output__init();
+    Keyboard__init();
+    Main__main();
+    return Sys__halt();
+}
+
+JACK_OS jack_word Sys__halt(void) {
+    fflush(stdout);
+    exit(0);
+}
+
+JACK_OS jack_word Sys__error(jack_word errorCode) {
+    printf("ERR%d\n", errorCode);
+    fflush(stdout);
+    exit(1);
+}
+
+JACK_OS jack_word Sys__wait(jack_word duration) {
+    if (duration < 0) Sys__error(1);
+    return 0;
+}
+
+
+/* Memory: first fit over a free list, a block is its size (header included) and, while free, the next block */
+
+static jack_word freeList;
+
+JACK_OS jack_word Memory__init(void) {
+    freeList = HEAP_BASE;
+    jack_ram[HEAP_BASE] = HEAP_END - HEAP_BASE;
+    jack_ram[HEAP_BASE + 1] = 0;
+    return 0;
+}
+
+JACK_OS jack_word Memory__peek(jack_word address) {
+    return JACK_RAM(address);
+}
+
+JACK_OS jack_word Memory__poke(jack_word address, jack_word value) {
+    JACK_RAM(address) = value;
+    return 0;
+}
+
+JACK_OS jack_word Memory__alloc(jack_word size) {
+    if (size <= 0) Sys__error(5);
+
+    int need = size + 1;
+    jack_word previous = 0;
+    for (jack_word block = freeList; block != 0; previous = block, block = jack_ram[block + 1]) {
+        int length = jack_ram[block];
+        if (length - need >= 2) {
+            jack_ram[block] = (jack_word)(length - need);
+            jack_word allocated = (jack_word)(block + length - need);
+            jack_ram[allocated] = (jack_word)need;
+            return (jack_word)(allocated + 1);
+        }
+        if (length >= need) {
+            if (previous == 0) {
+                freeList = jack_ram[block + 1];
+            } else {
+                jack_ram[previous + 1] = jack_ram[block + 1];
+            }
+            return (jack_word)(block + 1);
+        }
+    }
+    return Sys__error(6);
+}
+
+JACK_OS jack_word Memory__deAlloc(jack_word o) {
+    jack_word block = (jack_word)(o - 1);
+    JACK_RAM(block + 1) = freeList;
+    freeList = block;
+    return 0;
+}
+
+
+/* Array */
+
+JACK_OS jack_word Array__new(jack_word size) {
+    if (size <= 0) Sys__error(2);
+    return Memory__alloc(size);
+}
+
+JACK_OS jack_word Array__dispose(jack_word this) {
+    return Memory__deAlloc(this);
+}
+
+
+/* Math */
+
+JACK_OS jack_word Math__init(void) {
+    return 0;
+}
+
+JACK_OS jack_word Math__abs(jack_word x) {
+    return (jack_word)(x < 0 ? -x : x);
+}
+
+JACK_OS jack_word Math__multiply(jack_word x, jack_word y) {
+    return (jack_word)(x * y);
+}
+
+JACK_OS jack_word Math__divide(jack_word x, jack_word y) {
+    if (y == 0) Sys__error(3);
+    return (jack_word)(x / y);
+}
+
+JACK_OS jack_word Math__min(jack_word x, jack_word y) {
+    return x < y ? x : y;
+}
+
+JACK_OS jack_word Math__max(jack_word x, jack_word y) {
+    return x > y ? x : y;
+}
+
+JACK_OS jack_word Math__sqrt(jack_word x) {
+    if (x < 0) Sys__error(4);
+    int root = 0;
+    while ((root + 1) * (root + 1) <= x) root++;
+    return (jack_word)root;
+}
+
+
+/* String: maximum length, length, characters */
+
+JACK_OS jack_word String__new(jack_word maxLength) {
+    if (maxLength < 0) Sys__error(14);
+    jack_word s = Memory__alloc((jack_word)(maxLength + 2));
+    JACK_RAM(s) = maxLength;
+    JACK_RAM(s + 1) = 0;
+    return s;
+}
+
+JACK_OS jack_word String__dispose(jack_word this) {
+    return Memory__deAlloc(this);
+}
+
+JACK_OS jack_word String__length(jack_word this) {
+    return JACK_RAM(this + 1);
+}
+
+JACK_OS jack_word String__charAt(jack_word this, jack_word j) {
+    if (j < 0 || j >= JACK_RAM(this + 1)) Sys__error(15);
+    return JACK_RAM(this + 2 + j);
+}
+
+JACK_OS jack_word String__setCharAt(jack_word this, jack_word j, jack_word c) {
+    if (j < 0 || j >= JACK_RAM(this + 1)) Sys__error(16);
+    JACK_RAM(this + 2 + j) = c;
+    return 0;
+}
+
+JACK_OS jack_word String__appendChar(jack_word this, jack_word c) {
+    jack_word length = JACK_RAM(this + 1);
+    if (length >= JACK_RAM(this)) Sys__error(17);
+    JACK_RAM(this + 2 + length) = c;
+    JACK_RAM(this + 1) = (jack_word)(length + 1);
+    return this;
+}
+
+JACK_OS jack_word String__eraseLastChar(jack_word this) {
+    if (JACK_RAM(this + 1) == 0) Sys__error(18);
+    JACK_RAM(this + 1)--;
+    return 0;
+}
+
+JACK_OS jack_word String__intValue(jack_word this) {
+    int length = JACK_RAM(this + 1);
+    int negative = length > 0 && JACK_RAM(this + 2) == '-';
+    int value = 0;
+    for (int i = negative; i < length; i++) {
+        jack_word c = JACK_RAM(this + 2 + i);
+        if (c < '0' || c > '9') break;
+        value = value * 10 + (c - '0');
+    }
+    return (jack_word)(negative ? -value : value);
+}
+
+JACK_OS jack_word String__setInt(jack_word this, jack_word j) {
+    char digits[8];
+    int length = snprintf(digits, sizeof(digits), "%d", j);
+    if (length > JACK_RAM(this)) Sys__error(19);
+    for (int i = 0; i < length; i++) {
+        JACK_RAM(this + 2 + i) = digits[i];
+    }
+    JACK_RAM(this + 1) = (jack_word)length;
+    return 0;
+}
+
+JACK_OS jack_word String__newLine(void) {
+    return 128;
+}
+
+JACK_OS jack_word String__backSpace(void) {
+    return 129;
+}
+
+JACK_OS jack_word String__doubleQuote(void) {
+    return '"';
+}
+
+
+/* Output: text on stdout */
+
+JACK_OS jack_word Output__init(void) {
+    return 0;
+}
+
+JACK_OS jack_word Output__moveCursor(jack_word i, jack_word j) {
+    if (i < 0 || i > 22 || j < 0 || j > 63) Sys__error(20);
+    return 0;
+}
+
+JACK_OS jack_word Output__printChar(jack_word c) {
+    putchar(c == 128 ? '\n' : c == 129 ? '\b' : c);
+    return 0;
+}
+
+JACK_OS jack_word Output__printString(jack_word s) {
+    jack_word length = String__length(s);
+    for (jack_word i = 0; i < length; i++) {
+        Output__printChar(String__charAt(s, i));
+    }
+    return 0;
+}
+
+JACK_OS jack_word Output__printInt(jack_word i) {
+    printf("%d", i);
+    return 0;
+}
+
+JACK_OS jack_word Output__println(void) {
+    putchar('\n');
+    return 0;
+}
+
+JACK_OS jack_word Output__backSpace(void) {
+    putchar('\b');
+    return 0;
+}
+
+
+/* Screen: 512 x 256 pixels, 16 to a word */
+
+static jack_word color = -1;
+
+JACK_OS jack_word Screen__init(void) {
+    color = -1;
+    return 0;
+}
+
+JACK_OS jack_word Screen__clearScreen(void) {
+    for (int i = 0; i < 8192; i++) {
+        jack_ram[SCREEN + i] = 0;
+    }
+    return 0;
+}
+
+JACK_OS jack_word Screen__setColor(jack_word b) {
+    color = b;
+    return 0;
+}
+
+JACK_OS jack_word Screen__drawPixel(jack_word x, jack_word y) {
+    if (x < 0 || x > 511 || y < 0 || y > 255) Sys__error(7);
+    jack_word *word = &jack_ram[SCREEN + y * 32 + x / 16];
+    jack_word bit = (jack_word)(1 << (x % 16));
+    *word = color ? (jack_word)(*word | bit) : (jack_word)(*word & ~bit);
+    return 0;
+}
+
+static void drawHorizontal(jack_word x1, jack_word x2, jack_word y) {
+    for (jack_word x = x1; x <= x2; x++) {
+        Screen__drawPixel(x, y);
+    }
+}
+
+JACK_OS jack_word Screen__drawLine(jack_word x1, jack_word y1, jack_word x2, jack_word y2) {
+    if (x1 < 0 || x1 > 511 || y1 < 0 || y1 > 255 || x2 < 0 || x2 > 511 || y2 < 0 || y2 > 255) Sys__error(8);
+    int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+    int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+    int error = dx + dy;
+    int x = x1, y = y1;
+    while (1) {
+        Screen__drawPixel((jack_word)x, (jack_word)y);
+        if (x == x2 && y == y2) break;
+        if (2 * error >= dy) { error += dy; x += sx; }
+        if (2 * error <= dx) { error += dx; y += sy; }
+    }
+    return 0;
+}
+
+JACK_OS jack_word Screen__drawRectangle(jack_word x1, jack_word y1, jack_word x2, jack_word y2) {
+    if (x1 > x2 || y1 > y2 || x1 < 0 || x2 > 511 || y1 < 0 || y2 > 255) Sys__error(9);
+    for (jack_word y = y1; y <= y2; y++) {
+        drawHorizontal(x1, x2, y);
+    }
+    return 0;
+}
+
+JACK_OS jack_word Screen__drawCircle(jack_word x, jack_word y, jack_word r) {
+    if (x < 0 || x > 511 || y < 0 || y > 255) Sys__error(12);
+    if (r < 0 || r > 181) Sys__error(13);
+    for (int dy = -r; dy <= r; dy++) {
+        int half = 0;
+        while ((half + 1) * (half + 1) <= r * r - dy * dy) half++;
+        int left = x - half < 0 ? 0 : x - half;
+        int right = x + half > 511 ? 511 : x + half;
+        if (y + dy >= 0 && y + dy <= 255) {
+            drawHorizontal((jack_word)left, (jack_word)right, (jack_word)(y + dy));
+        }
+    }
+    return 0;
+}
+
+
+/* Keyboard: lines from stdin, no key is ever held down */
+
+JACK_OS jack_word Keyboard__init(void) {
+    return 0;
+}
+
+JACK_OS jack_word Keyboard__keyPressed(void) {
+    return 0;
+}
+
+JACK_OS jack_word Keyboard__readChar(void) {
+    int c = getchar();
+    if (c == EOF) Sys__halt();
+    return (jack_word)(c == '\n' ? 128 : c);
+}
+
+JACK_OS jack_word Keyboard__readLine(jack_word message) {
+    char line[MAX_LINE];
+    Output__printString(message);
+    fflush(stdout);
+    if (!fgets(line, sizeof(line), stdin)) Sys__halt();
+
+    int length = 0;
+    while (line[length] != '\0' && line[length] != '\n') length++;
+    jack_word s = String__new((jack_word)length);
+    for (int i = 0; i < length; i++) {
+        String__appendChar(s, line[i]);
+    }
+    return s;
+}
+
+JACK_OS jack_word Keyboard__readInt(jack_word message) {
+    jack_word s = Keyboard__readLine(message);
+    jack_word value = String__intValue(s);
+    String__dispose(s);
+    return value;
+}
@@ -0,0 +1,506 @@
+#include <AsyncIO/io.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+static const unsigned RING_ENTRIES = 64;
+static const size_t READ_THREADS = 8;
+
+
+/*
+ *  Minimal io_uring driver on the raw system calls, a batch of operations is
+ *  submitted and waited for as a whole. The submission ring never holds more
+ *  than its size in flight and the completion ring is twice that, nothing can
+ *  overflow.
+ */
+class AsyncIO::Ring {
+    int fd = -1;
+    unsigned entries = 0;
+
+    void *sqMap = MAP_FAILED;
+    void *cqMap = MAP_FAILED;
+    void *sqeMap = MAP_FAILED;
+    size_t sqMapSize = 0;
+    size_t cqMapSize = 0;
+    size_t sqeMapSize = 0;
+
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    bool broken = false;                            /* a submission failed, the ring is not used again */
+
+    Ring() = default;
+    void drain(unsigned nSubmitted, vector<int> &results);  /* wait until the kernel is done with every submitted operation */
+public:
+    static unique_ptr<Ring> open(unsigned nEntries);     /* nullptr when the kernel has no io_uring */
+    ~Ring();
+
+    /* run every operation, results[i] is the res of ops[i], false if the ring itself failed
+       (the operations that did run still have their results, the rest -ECANCELED) */
+    bool run(vector<io_uring_sqe> &ops, vector<int> &results);
+    void closeAll(const vector<int> &fds);          /* close every open descriptor (>= 0) in one submission */
+};
+
+unique_ptr<AsyncIO::Ring> AsyncIO::Ring::open(unsigned nEntries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    unique_ptr<Ring> ring (new Ring());
+    ring->fd = syscall(__NR_io_uring_setup, nEntries, &params);
+    if (ring->fd < 0) {
+        return nullptr;
+    }
+    ring->entries = params.sq_entries;
+
+    ring->sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sqMapSize = ring->cqMapSize = max(ring->sqMapSize, ring->cqMapSize);
+    }
+
+    ring->sqMap = mmap(nullptr, ring->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqMap == MAP_FAILED) {
+        return nullptr;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cqMap = ring->sqMap;
+    } else {
+        ring->cqMap = mmap(nullptr, ring->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqMap == MAP_FAILED) {
+            return nullptr;
+        }
+    }
+    ring->sqeMapSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqeMap = mmap(nullptr, ring->sqeMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqeMap == MAP_FAILED) {
+        return nullptr;
+    }
+
+    char *sq = static_cast<char *>(ring->sqMap);
+    char *cq = static_cast<char *>(ring->cqMap);
+    ring->sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    ring->sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    ring->sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    ring->cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    ring->cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    ring->cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    ring->sqes = static_cast<io_uring_sqe *>(ring->sqeMap);
+    ring->cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return ring;
+}
+
+AsyncIO::Ring::~Ring() {
+    if (sqeMap != MAP_FAILED) munmap(sqeMap, sqeMapSize);
+    if (cqMap != MAP_FAILED && cqMap != sqMap) munmap(cqMap, cqMapSize);
+    if (sqMap != MAP_FAILED) munmap(sqMap, sqMapSize);
+    if (fd >= 0) close(fd);
+}
+
+void AsyncIO::Ring::drain(unsigned nSubmitted, vector<int> &results) {
+    while (nSubmitted > 0) {
+        unsigned head = *cqHead;
+        unsigned available = atomic_ref<unsigned>(*cqTail).load(memory_order_acquire);
+        if (head != available) {
+            for (; head != available && nSubmitted > 0; head++, nSubmitted--) {
+                const io_uring_cqe &cqe = cqes[head & *cqMask];
+                results[cqe.user_data] = cqe.res;
+            }
+            atomic_ref<unsigned>(*cqHead).store(head, memory_order_release);
+            continue;
+        }
+
+        // the kernel posts completions without being entered, waiting in it is only quicker
+        if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+}
+
+bool AsyncIO::Ring::run(vector<io_uring_sqe> &ops, vector<int> &results) {
+    results.assign(ops.size(), -ECANCELED);
+    if (broken) {
+        return false;
+    }
+
+    size_t next = 0;
+    size_t done = 0;
+    unsigned inFlight = 0;
+    unsigned unsubmitted = 0;
+    while (done < ops.size()) {
+        // the kernel reads the tail, everything before it has to be visible first
+        unsigned tail = *sqTail;
+        while (next < ops.size() && inFlight < entries) {
+            unsigned slot = tail & *sqMask;
+            sqes[slot] = ops[next];
+            sqes[slot].user_data = next;
+            sqArray[slot] = slot;
+            tail++;
+            next++;
+            inFlight++;
+            unsubmitted++;
+        }
+        atomic_ref<unsigned>(*sqTail).store(tail, memory_order_release);
+
+        int submitted = syscall(__NR_io_uring_enter, fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (submitted < 0) {
+            if (errno == EINTR) continue;
+            // the operations in flight point into the caller's buffers, they have to be done before it gets them back
+            broken = true;
+            drain(inFlight - unsubmitted, results);
+            return false;
+        }
+        unsubmitted -= submitted;
+
+        unsigned head = *cqHead;
+        unsigned available = atomic_ref<unsigned>(*cqTail).load(memory_order_acquire);
+        for (; head != available; head++) {
+            const io_uring_cqe &cqe = cqes[head & *cqMask];
+            results[cqe.user_data] = cqe.res;
+            done++;
+            inFlight--;
+        }
+        atomic_ref<unsigned>(*cqHead).store(head, memory_order_release);
+    }
+
+    return true;
+}
+
+
+/* Begin Helper Function */
+
+// error is set to the errno of a file that can't be read
+static string readFile(const fs::path &file, int &error) {
+    if (fs::is_directory(file)) {
+        error = EISDIR;
+        return "";
+    }
+    ifstream in (file, ios::binary);
+    if (!in) {
+        error = errno != 0 ? errno : EIO;
+        return "";
+    }
+    ostringstream content;
+    content << in.rdbuf();
+    if (in.bad()) {
+        error = EIO;
+        return "";
+    }
+    error = 0;
+    return content.str();
+}
+
+static io_uring_sqe openOp(const string &path, int flags) {
+    io_uring_sqe op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = IORING_OP_OPENAT;
+    op.fd = AT_FDCWD;
+    op.addr = reinterpret_cast<uintptr_t>(path.c_str());
+    op.len = 0666;
+    op.open_flags = flags | O_CLOEXEC;
+    return op;
+}
+
+static io_uring_sqe statxOp(const string &path, struct statx *result) {
+    io_uring_sqe op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = IORING_OP_STATX;
+    op.fd = AT_FDCWD;
+    op.addr = reinterpret_cast<uintptr_t>(path.c_str());
+    op.len = STATX_SIZE;
+    op.off = reinterpret_cast<uintptr_t>(result);
+    return op;
+}
+
+static io_uring_sqe transferOp(uint8_t opcode, int fd, const char *buffer, size_t size, size_t offset) {
+    io_uring_sqe op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = opcode;
+    op.fd = fd;
+    op.addr = reinterpret_cast<uintptr_t>(buffer);
+    op.len = size;
+    op.off = offset;
+    return op;
+}
+
+static io_uring_sqe closeOp(int fd) {
+    io_uring_sqe op;
+    memset(&op, 0, sizeof(op));
+    op.opcode = IORING_OP_CLOSE;
+    op.fd = fd;
+    return op;
+}
+
+/* End Helper Function */
+
+
+void AsyncIO::Ring::closeAll(const vector<int> &fds) {
+    vector<io_uring_sqe> ops;
+    for (int descriptor : fds) {
+        if (descriptor >= 0) ops.push_back(closeOp(descriptor));
+    }
+
+    vector<int> results;
+    if (!run(ops, results)) {
+        for (int descriptor : fds) {
+            if (descriptor >= 0) close(descriptor);
+        }
+    }
+}
+
+
+AsyncIO::AsyncIO() {
+    uring = Ring::open(RING_ENTRIES) != nullptr;
+    if (!uring) {
+        readers = make_unique<ThreadPool>(READ_THREADS);
+    }
+
+    writer = thread(&AsyncIO::runWriter, this);
+}
+
+AsyncIO::~AsyncIO() {
+    {
+        lock_guard<mutex> guard(queueLock);
+        stopping = true;
+    }
+    queued.notify_all();
+    writer.join();
+}
+
+vector<string> AsyncIO::readAll(const vector<fs::path> &files, vector<int> &errors) {
+    vector<string> contents(files.size());
+    errors.assign(files.size(), 0);
+    unique_ptr<Ring> ring = uring ? Ring::open(RING_ENTRIES) : nullptr;
+    if (!ring) {
+        // a ring that can't be set up now (out of locked memory) leaves the caller to read
+        auto readOne = [&](size_t i) { contents[i] = readFile(files[i], errors[i]); };
+        if (readers) {
+            readers->parallelFor(files.size(), readOne);
+        } else {
+            for (size_t i = 0; i < files.size(); i++) readOne(i);
+        }
+        return contents;
+    }
+
+    // open and stat everything at once, the size picks the first read
+    vector<string> paths(files.size());
+    vector<struct statx> stats(files.size());
+    vector<io_uring_sqe> ops;
+    for (size_t i = 0; i < files.size(); i++) {
+        paths[i] = files[i].string();
+        ops.push_back(openOp(paths[i], O_RDONLY));
+        ops.push_back(statxOp(paths[i], &stats[i]));
+    }
+
+    vector<int> results;
+    vector<int> fds(files.size(), -1);
+    vector<char> failed(files.size(), true);
+    vector<size_t> lengths(files.size(), 0);
+    vector<size_t> sizes(files.size(), 0);
+    vector<size_t> pending;
+    // the files a failed ring did open still get closed
+    bool opened = ring->run(ops, results);
+    for (size_t i = 0; i < files.size(); i++) {
+        fds[i] = results[2 * i];
+        if (fds[i] < 0 || !opened) continue;
+
+        failed[i] = false;
+        sizes[i] = results[2 * i + 1] == 0 ? stats[i].stx_size : 0;
+        contents[i].resize(sizes[i] + 1);
+        pending.push_back(i);
+    }
+
+    // a read that comes back short at the expected size has hit the end, anything
+    // else (a file that grew, or a filesystem serving partial reads) reads on
+    while (!pending.empty()) {
+        ops.clear();
+        for (size_t i : pending) {
+            if (lengths[i] == contents[i].size()) {
+                contents[i].resize(contents[i].size() * 2);
+            }
+            ops.push_back(transferOp(IORING_OP_READ, fds[i], contents[i].data() + lengths[i],
+                    contents[i].size() - lengths[i], lengths[i]));
+        }
+
+        if (!ring->run(ops, results)) {
+            for (size_t i : pending) failed[i] = true;
+            break;
+        }
+
+        vector<size_t> next;
+        for (size_t k = 0; k < pending.size(); k++) {
+            size_t i = pending[k];
+            if (results[k] < 0) {
+                failed[i] = true;
+                continue;
+            }
+
+            size_t requested = ops[k].len;
+            lengths[i] += results[k];
+            bool atEnd = results[k] == 0 || (static_cast<size_t>(results[k]) < requested && lengths[i] >= sizes[i]);
+            if (!atEnd) next.push_back(i);
+        }
+        pending.swap(next);
+    }
+
+    ring->closeAll(fds);
+
+    for (size_t i = 0; i < files.size(); i++) {
+        if (failed[i]) {
+            // the plain read tells why a file can't be read, and copes with whatever the ring didn't
+            contents[i] = readFile(files[i], errors[i]);
+        } else {
+            contents[i].resize(lengths[i]);
+        }
+    }
+    return contents;
+}
+
+void AsyncIO::write(const fs::path &file, string content) {
+    {
+        lock_guard<mutex> guard(queueLock);
+        jobs.push_back(Job {file, move(content), nullptr});
+        nQueued++;
+    }
+    queued.notify_one();
+}
+
+void AsyncIO::defer(function<void()> task) {
+    {
+        lock_guard<mutex> guard(queueLock);
+        jobs.push_back(Job {fs::path(), string(), move(task)});
+        nQueued++;
+    }
+    queued.notify_one();
+}
+
+void AsyncIO::flush() {
+    unique_lock<mutex> guard(queueLock);
+    size_t target = nQueued;
+    finished.wait(guard, [&] { return nFinished >= target; });
+}
+
+
+/* Begin Private Methods */
+
+// takes whatever is queued as one batch, a deferred task ends the batch so it runs after the writes before it
+void AsyncIO::runWriter() {
+    unique_ptr<Ring> ring = uring ? Ring::open(RING_ENTRIES) : nullptr;
+
+    while (true) {
+        vector<Job> batch;
+        {
+            unique_lock<mutex> guard(queueLock);
+            queued.wait(guard, [&] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return;
+            }
+
+            while (!jobs.empty() && (batch.empty() || !batch.back().task)) {
+                if (jobs.front().task && !batch.empty()) break;
+                batch.push_back(move(jobs.front()));
+                jobs.pop_front();
+            }
+        }
+
+        if (batch.back().task) {
+            try {
+                batch.back().task();
+            } catch (...) {
+                // a failing task (a cache that can't be written) must not take the writer down
+            }
+        } else {
+            writeBatch(ring.get(), batch);
+        }
+
+        {
+            lock_guard<mutex> guard(queueLock);
+            nFinished += batch.size();
+        }
+        finished.notify_all();
+    }
+}
+
+void AsyncIO::writeBatch(Ring *ring, vector<Job> &batch) {
+    vector<char> failed(batch.size(), true);
+    vector<int> fds(batch.size(), -1);
+    vector<int> results;
+
+    if (ring) {
+        vector<string> paths(batch.size());
+        vector<io_uring_sqe> ops;
+        for (size_t i = 0; i < batch.size(); i++) {
+            paths[i] = batch[i].file.string();
+            ops.push_back(openOp(paths[i], O_WRONLY | O_CREAT | O_TRUNC));
+        }
+
+        vector<size_t> pending;
+        bool opened = ring->run(ops, results);
+        for (size_t i = 0; i < batch.size(); i++) {
+            fds[i] = results[i];
+            if (fds[i] < 0 || !opened) continue;
+
+            failed[i] = false;
+            if (!batch[i].content.empty()) pending.push_back(i);
+        }
+
+        // short writes carry on from where they stopped
+        vector<size_t> written(batch.size(), 0);
+        while (!pending.empty()) {
+            ops.clear();
+            for (size_t i : pending) {
+                const string &content = batch[i].content;
+                ops.push_back(transferOp(IORING_OP_WRITE, fds[i], content.data() + written[i],
+                        content.size() - written[i], written[i]));
+            }
+
+            if (!ring->run(ops, results)) {
+                for (size_t i : pending) failed[i] = true;
+                break;
+            }
+
+            vector<size_t> next;
+            for (size_t k = 0; k < pending.size(); k++) {
+                size_t i = pending[k];
+                if (results[k] <= 0) {
+                    failed[i] = true;
+                    continue;
+                }
+
+                written[i] += results[k];
+                if (written[i] < batch[i].content.size()) next.push_back(i);
+            }
+            pending.swap(next);
+        }
+
+        ring->closeAll(fds);
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        if (failed[i]) {
+            ofstream(batch[i].file, ios::binary) << batch[i].content;
+        }
+    }
+}
+
+/* End Private Methods */
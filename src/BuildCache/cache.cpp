@@ -0,0 +1,141 @@
+#include <BuildCache/cache.hpp>
+#include <LruCache/lru.hpp>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+/* entries kept by resident processes, the least recently used go once there are RESIDENT_ENTRIES */
+typedef struct resident_entry_struct {
+    string vm;
+    BuildCache::Dependencies deps;
+} ResidentEntry;
+
+static const size_t RESIDENT_ENTRIES = 4096;
+static mutex residentLock;
+static LruCache<string, ResidentEntry, RESIDENT_ENTRIES> residentEntries;
+
+
+fs::path BuildCache::entryPath(const string &key) const {
+    return dir / (key + ".entry");
+}
+
+fs::path BuildCache::tmpPathOf(const fs::path &file) const {
+    fs::path tmp = file;
+    tmp += ".tmp." + to_string(getpid()) + "." + to_string(std::hash<thread::id>{}(this_thread::get_id()));
+    return tmp;
+}
+
+// write under a unique name first so readers never see a half written entry
+void BuildCache::storeFile(const string &content, const fs::path &to) const {
+    error_code ec;
+    fs::path tmp = tmpPathOf(to);
+
+    {
+        ofstream out (tmp, ios::binary);
+        out << content;
+        if (!out) {
+            return;
+        }
+    }
+
+    fs::rename(tmp, to, ec);
+    if (ec) {
+        fs::remove(tmp, ec);
+    }
+}
+
+uint64_t BuildCache::hash(string_view data, uint64_t seed) {
+    uint64_t h = seed;
+    for (unsigned char c : data) {
+        h ^= c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+string BuildCache::keyOf(string_view source, string_view salt) {
+    static const char HEX[] = "0123456789abcdef";
+
+    uint64_t h = hash(source, hash(salt));
+    string key(16, '0');
+    for (size_t i = 0; i < 16; i++) {
+        key[15 - i] = HEX[h & 0xf];
+        h >>= 4;
+    }
+    return key;
+}
+
+bool BuildCache::restore(const string &key, string &vm,
+        const function<uint64_t(const string &)> &interfaceHashOf) const {
+    if (resident) {
+        unique_lock<mutex> guard(residentLock);
+        if (const ResidentEntry *result = residentEntries.find(key)) {
+            ResidentEntry entry = *result;
+            guard.unlock();
+
+            for (const auto &[className, interfaceHash] : entry.deps) {
+                if (interfaceHashOf(className) != interfaceHash) {
+                    return false;
+                }
+            }
+
+            vm = move(entry.vm);
+            return true;
+        }
+    }
+
+    if (dir.empty()) {
+        return false;
+    }
+
+    ifstream in (entryPath(key), ios::binary);
+    size_t nDeps;
+    if (!(in >> nDeps)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < nDeps; i++) {
+        string className;
+        uint64_t interfaceHash;
+        if (!(in >> className >> interfaceHash) || interfaceHashOf(className) != interfaceHash) {
+            return false;
+        }
+    }
+    if (in.get() != '\n') {
+        return false;
+    }
+
+    ostringstream content;
+    content << in.rdbuf();
+    vm = content.str();
+    return true;
+}
+
+void BuildCache::store(const string &key, const string &vm, const Dependencies &deps) const {
+    if (resident) {
+        lock_guard<mutex> guard(residentLock);
+        residentEntries.insert(key, ResidentEntry {vm, deps});
+    }
+
+    if (dir.empty()) {
+        return;
+    }
+
+    error_code ec;
+    fs::create_directories(dir, ec);
+
+    ostringstream entry;
+    entry << deps.size() << "\n";
+    for (const auto &[className, interfaceHash] : deps) {
+        entry << className << " " << interfaceHash << "\n";
+    }
+    entry << vm;
+    storeFile(entry.str(), entryPath(key));
+}
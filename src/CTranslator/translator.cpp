@@ -0,0 +1,340 @@
+#include <CTranslator/translator.hpp>
+#include <cctype>
+#include <set>
+#include <stdexcept>
+
+using namespace std;
+
+
+/* Begin Helper Function */
+
+// Class.name becomes Class__name, anything else C doesn't allow becomes _
+static string identifier(const string &name) {
+    string id;
+    for (char c : name) {
+        if (c == '.') {
+            id += "__";
+        } else {
+            id += isalnum(static_cast<unsigned char>(c)) || c == '_' ? c : '_';
+        }
+    }
+    return id;
+}
+
+static bool isUnary(const Instruction &instruction) {
+    return instruction.opcode == Opcode::ARITHMETIC
+            && (Command(instruction.kind) == Command::NEG || Command(instruction.kind) == Command::NOT);
+}
+
+// values an instruction takes off the stack and puts back
+static int pops(const Instruction &instruction) {
+    switch (instruction.opcode) {
+        case Opcode::POP:
+        case Opcode::IF_GOTO:
+        case Opcode::RETURN:
+            return 1;
+        case Opcode::ARITHMETIC:
+            return isUnary(instruction) ? 1 : 2;
+        case Opcode::CALL:
+            return int(instruction.operand);
+        default:
+            return 0;
+    }
+}
+
+static int pushes(const Instruction &instruction) {
+    return instruction.opcode == Opcode::PUSH || instruction.opcode == Opcode::ARITHMETIC || instruction.opcode == Opcode::CALL;
+}
+
+static string slot(int index) {
+    return "s" + to_string(index);
+}
+
+static string join(const set<uint32_t> &indices, const string &prefix, const string &init) {
+    string list;
+    for (uint32_t index : indices) {
+        list += (list.empty() ? "" : ", ") + prefix + to_string(index) + init;
+    }
+    return list;
+}
+
+/* End Helper Function */
+
+
+/* Begin Private Methods */
+
+string CTranslator::prototype(const string &name) const {
+    uint32_t arity = functions.at(name).arity;
+    string text = "jack_word " + identifier(name) + "(";
+    for (uint32_t i = 0; i < arity; i++) {
+        text += (i == 0 ? "jack_word a" : ", jack_word a") + to_string(i);
+    }
+    return text + (arity == 0 ? "void)" : ")");
+}
+
+string CTranslator::translateFunction(const Unit &unit, size_t begin, size_t end) {
+    const auto &code = unit.program.code;
+    const auto &names = unit.program.names;
+    const string &name = names[code[begin].name];
+
+    map<uint32_t, size_t> labels;
+    for (size_t k = begin + 1; k < end; k++) {
+        if (code[k].opcode == Opcode::LABEL) {
+            labels[code[k].name] = k;
+        }
+    }
+    auto target = [&](const Instruction &instruction) {
+        auto label = labels.find(instruction.name);
+        if (label == labels.end()) {
+            throw runtime_error(name + ": jump to unknown label " + names[instruction.name]);
+        }
+        return label->second;
+    };
+
+    // stack depth before every reachable instruction, -1 for dead code
+    vector<int> depth(end - begin, -1);
+    vector<size_t> work;
+    bool fallsOff = false;
+    auto reach = [&](size_t k, int d) {
+        if (k >= end) {
+            fallsOff = true;
+            return;
+        }
+        int &known = depth[k - begin];
+        if (known == -1) {
+            known = d;
+            work.push_back(k);
+        } else if (known != d) {
+            throw runtime_error(name + ": the stack depth differs where control flow joins");
+        }
+    };
+
+    reach(begin + 1, 0);
+    int maxDepth = 0;
+    set<uint32_t> targets;
+    while (!work.empty()) {
+        size_t k = work.back();
+        work.pop_back();
+        const Instruction &instruction = code[k];
+        int d = depth[k - begin];
+        if (d < pops(instruction)) {
+            throw runtime_error(name + ": pops from an empty stack");
+        }
+        int after = d - pops(instruction) + pushes(instruction);
+        maxDepth = max(maxDepth, after);
+
+        switch (instruction.opcode) {
+            case Opcode::GOTO:
+                reach(target(instruction), after);
+                targets.insert(instruction.name);
+                break;
+            case Opcode::IF_GOTO:
+                reach(target(instruction), after);
+                reach(k + 1, after);
+                targets.insert(instruction.name);
+                break;
+            case Opcode::RETURN:
+                break;
+            default:
+                reach(k + 1, after);
+                break;
+        }
+    }
+
+    // a do statement discards the result through a temp the function never reads
+    set<uint32_t> readTemps;
+    for (size_t k = begin + 1; k < end; k++) {
+        if (code[k].opcode == Opcode::PUSH && Segment(code[k].kind) == Segment::TEMP) {
+            readTemps.insert(code[k].operand);
+        }
+    }
+
+    // the body first, the declarations only of what it used
+    string body;
+    set<uint32_t> locals;
+    set<uint32_t> temps;
+    bool usesThis = false;
+    bool usesThat = false;
+    auto access = [&](Segment segment, uint32_t index) -> string {
+        string i = to_string(index);
+        switch (segment) {
+            case Segment::CONST:
+                throw runtime_error(name + ": pop constant");
+            case Segment::LOCAL:
+                locals.insert(index);
+                return "l" + i;
+            case Segment::ARG:
+                return "a" + i;
+            case Segment::THIS:
+                usesThis = true;
+                return "JACK_RAM(pthis + " + i + ")";
+            case Segment::THAT:
+                usesThat = true;
+                return "JACK_RAM(pthat + " + i + ")";
+            case Segment::POINTER:
+                (index == 0 ? usesThis : usesThat) = true;
+                return index == 0 ? "pthis" : "pthat";
+            case Segment::TEMP:
+                temps.insert(index);
+                return "t" + i;
+            default:
+                return "S_" + identifier(unit.fileName) + "[" + i + "]";
+        }
+    };
+
+    for (size_t k = begin + 1; k < end; k++) {
+        const Instruction &instruction = code[k];
+        int d = depth[k - begin];
+        if (d < 0) continue;
+
+        string x = slot(d - 2);
+        string y = slot(d - 1);
+        switch (instruction.opcode) {
+            case Opcode::PUSH: {
+                Segment segment = Segment(instruction.kind);
+                string value = segment == Segment::CONST ? to_string(int16_t(instruction.operand)) : access(segment, instruction.operand);
+                body += "    " + slot(d) + " = " + value + ";\n";
+                break;
+            }
+            case Opcode::POP:
+                if (Segment(instruction.kind) != Segment::TEMP || readTemps.count(instruction.operand)) {
+                    body += "    " + access(Segment(instruction.kind), instruction.operand) + " = " + y + ";\n";
+                }
+                break;
+            case Opcode::ARITHMETIC:
+                switch (Command(instruction.kind)) {
+                    case Command::ADD:
+                        body += "    " + x + " = (jack_word)(" + x + " + " + y + ");\n";
+                        break;
+                    case Command::SUB:
+                        body += "    " + x + " = (jack_word)(" + x + " - " + y + ");\n";
+                        break;
+                    case Command::NEG:
+                        body += "    " + y + " = (jack_word)-" + y + ";\n";
+                        break;
+                    case Command::EQ:
+                        body += "    " + x + " = -(" + x + " == " + y + ");\n";
+                        break;
+                    case Command::GT:
+                        body += "    " + x + " = -(" + x + " > " + y + ");\n";
+                        break;
+                    case Command::LT:
+                        body += "    " + x + " = -(" + x + " < " + y + ");\n";
+                        break;
+                    case Command::AND:
+                        body += "    " + x + " &= " + y + ";\n";
+                        break;
+                    case Command::OR:
+                        body += "    " + x + " |= " + y + ";\n";
+                        break;
+                    case Command::NOT:
+                        body += "    " + y + " = ~" + y + ";\n";
+                        break;
+                }
+                break;
+            case Opcode::LABEL:
+                if (targets.count(instruction.name)) {
+                    body += "L" + to_string(instruction.name) + ":;\n";
+                }
+                break;
+            case Opcode::GOTO:
+                body += "    goto L" + to_string(instruction.name) + ";\n";
+                break;
+            case Opcode::IF_GOTO:
+                body += "    if (" + y + ") goto L" + to_string(instruction.name) + ";\n";
+                break;
+            case Opcode::CALL: {
+                const string &callee = names[instruction.name];
+                int nArgs = int(instruction.operand);
+                string arguments;
+                for (int i = 0; i < int(functions[callee].arity); i++) {
+                    arguments += (i == 0 ? "" : ", ") + (i < nArgs ? slot(d - nArgs + i) : string("0"));
+                }
+                body += "    " + slot(d - nArgs) + " = " + identifier(callee) + "(" + arguments + ");\n";
+                break;
+            }
+            case Opcode::RETURN:
+                body += "    return " + y + ";\n";
+                break;
+            case Opcode::FUNCTION:
+                break;
+        }
+    }
+    if (fallsOff) {
+        body += "    return 0;\n";
+    }
+
+    for (uint32_t i = 0; i < code[begin].operand; i++) {
+        locals.insert(i);
+    }
+    string declarations;
+    if (maxDepth > 0) {
+        set<uint32_t> slots;
+        for (int i = 0; i < maxDepth; i++) slots.insert(i);
+        declarations += "    jack_word " + join(slots, "s", "") + ";\n";
+    }
+    if (!locals.empty()) declarations += "    jack_word " + join(locals, "l", " = 0") + ";\n";
+    if (!temps.empty()) declarations += "    jack_word " + join(temps, "t", " = 0") + ";\n";
+    if (usesThis) declarations += "    jack_word pthis = 0;\n";
+    if (usesThat) declarations += "    jack_word pthat = 0;\n";
+
+    return prototype(name) + " {\n" + declarations + body + "}\n\n";
+}
+
+/* End Private Methods */
+
+
+void CTranslator::translate(const VMProgram &program, const string &fileName) {
+    units.push_back(Unit {fileName, program});
+}
+
+string CTranslator::finish() {
+    // every function, its arity and whether the program defines it
+    map<string, uint32_t> nStatics;
+    for (const auto &unit : units) {
+        string current;
+        for (const auto &instruction : unit.program.code) {
+            if (instruction.opcode == Opcode::FUNCTION) {
+                current = unit.program.names[instruction.name];
+                functions[current].defined = true;
+            } else if (instruction.opcode == Opcode::CALL) {
+                auto &callee = functions[unit.program.names[instruction.name]];
+                callee.arity = max(callee.arity, instruction.operand);
+            } else if (instruction.opcode == Opcode::PUSH || instruction.opcode == Opcode::POP) {
+                if (Segment(instruction.kind) == Segment::ARG && !current.empty()) {
+                    functions[current].arity = max(functions[current].arity, instruction.operand + 1);
+                } else if (Segment(instruction.kind) == Segment::STATIC) {
+                    nStatics[unit.fileName] = max(nStatics[unit.fileName], instruction.operand + 1);
+                }
+            }
+        }
+    }
+    functions["Sys.init"];
+
+    string c = "/* generated by jackc, build with: cc -O2 -Iruntime <this file> runtime/jackos.c */\n";
+    c += "#include \"jack.h\"\n\n";
+    for (const auto &statics : nStatics) {
+        c += "static jack_word S_" + identifier(statics.first) + "[" + to_string(statics.second) + "];\n";
+    }
+    c += "\n";
+    for (const auto &function : functions) {
+        c += prototype(function.first) + ";\n";
+    }
+    c += "\n";
+
+    for (const auto &unit : units) {
+        const auto &code = unit.program.code;
+        size_t begin = code.size();
+        for (size_t k = 0; k <= code.size(); k++) {
+            if (k == code.size() || code[k].opcode == Opcode::FUNCTION) {
+                if (begin < k) c += translateFunction(unit, begin, k);
+                begin = k;
+            }
+        }
+    }
+
+    c += "int main(void) {\n    Sys__init();\n    return 0;\n}\n";
+    units.clear();
+    functions.clear();
+    return c;
+}
@@ -0,0 +1,358 @@
+#include <ClassIndex/index.hpp>
+#include <BuildCache/cache.hpp>
+#include <JackTokenizer/tokenizer.hpp>
+#include <LruCache/lru.hpp>
+#include <TimeReport/report.hpp>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+
+using namespace std;
+
+
+/* summaries kept by resident processes, the least recently used go once there are RESIDENT_SUMMARIES */
+static const size_t RESIDENT_SUMMARIES = 4096;
+static mutex residentLock;
+static LruCache<uint64_t, pair<string, ClassSummary>, RESIDENT_SUMMARIES> residentSummaries;
+
+
+/* Begin Helper Function */
+
+static string tokenText(Tokenizer &tokenizer) {
+    switch (tokenizer.tokenType()) {
+        case Token::KEYWORD:
+            return Tokenizer::KEYWORDMAPPING.right.find(tokenizer.keyWord())->second;
+        case Token::SYMBOL:
+            return string(1, tokenizer.symbol());
+        case Token::INT_CONST:
+            return to_string(tokenizer.intVal());
+        case Token::STRING_CONST:
+            return "\"" + tokenizer.stringVal() + "\"";
+        case Token::IDENTIFIER:
+        default:
+            return tokenizer.identifier();
+    }
+}
+
+static void putVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static void putHash(string &out, uint64_t value) {
+    for (size_t i = 0; i < 8; i++) {
+        out.push_back(char(value >> (8 * i)));
+    }
+}
+
+static void putString(string &out, const string &value) {
+    putVarint(out, value.size());
+    out += value;
+}
+
+static bool getVarint(istream &in, uint64_t &value) {
+    value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) return false;
+        value |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool getHash(istream &in, uint64_t &value) {
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char *>(bytes), 8)) return false;
+    value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= uint64_t(bytes[i]) << (8 * i);
+    }
+    return true;
+}
+
+static bool getString(istream &in, string &value) {
+    uint64_t size;
+    if (!getVarint(in, size) || size > (1 << 20)) return false;
+    value.resize(size);
+    return bool(in.read(value.data(), size));
+}
+
+static fs::path summaryPathOf(const fs::path &file) {
+    fs::path summary = file;
+    return summary.replace_extension(".vmi");
+}
+
+/* End Helper Function */
+
+
+
+/* Begin Private Methods */
+
+// walks the tokens of a class declaration, only looking at subroutine headers
+// and hashing their bodies, returns false if the file doesn't look like a class
+// or its braces don't balance
+bool ClassIndex::scanClass(istream &in, string &className, ClassSummary &summary) {
+    Tokenizer tokenizer(in);
+
+    if (tokenizer.tokenType() != Token::KEYWORD || tokenizer.keyWord() != Keyword::CLASS) return false;
+    tokenizer.advance();
+    if (tokenizer.tokenType() != Token::IDENTIFIER) return false;
+    className = tokenizer.identifier();
+    tokenizer.advance();
+
+    size_t depth = 0;
+    Subroutine *current = nullptr;                  /* subroutine whose body is being hashed */
+    while (tokenizer.hasMoreTokens()) {
+        Token type = tokenizer.tokenType();
+
+        if (depth >= 2 && current != nullptr) {
+            current->bodyHash = BuildCache::hash(tokenText(tokenizer), current->bodyHash);
+        }
+
+        if (type == Token::SYMBOL) {
+            char sym = tokenizer.symbol();
+            if (sym == '{') {
+                depth++;
+            } else if (sym == '}') {
+                // unbalanced braces, the parser reports where
+                if (depth == 0) return false;
+                depth--;
+            }
+            tokenizer.advance();
+            continue;
+        }
+
+        if (depth != 1 || type != Token::KEYWORD) {
+            tokenizer.advance();
+            continue;
+        }
+
+        Keyword kind = tokenizer.keyWord();
+        if (kind != Keyword::CONSTRUCTOR && kind != Keyword::FUNCTION && kind != Keyword::METHOD) {
+            tokenizer.advance();
+            continue;
+        }
+
+        // ( 'constructor' | 'function' | 'method' ) ( 'void' | type ) subroutineName '(' parameterList ')'
+        Subroutine subroutine;
+        subroutine.kind = kind;
+        subroutine.nParams = 0;
+        subroutine.bodyHash = BuildCache::hash("");
+
+        tokenizer.advance();
+        if (tokenizer.tokenType() == Token::IDENTIFIER) {
+            subroutine.returnType = tokenizer.identifier();
+        } else {
+            auto result = Tokenizer::KEYWORDMAPPING.right.find(tokenizer.keyWord());
+            subroutine.returnType = result->second;
+        }
+
+        tokenizer.advance();
+        string name = tokenizer.identifier();
+        tokenizer.advance();
+        tokenizer.advance();    /* '(' */
+
+        if (tokenizer.tokenType() != Token::SYMBOL || tokenizer.symbol() != ')') {
+            subroutine.nParams = 1;
+            while (tokenizer.hasMoreTokens() && (tokenizer.tokenType() != Token::SYMBOL || tokenizer.symbol() != ')')) {
+                if (tokenizer.tokenType() == Token::SYMBOL && tokenizer.symbol() == ',') {
+                    subroutine.nParams++;
+                }
+                tokenizer.advance();
+            }
+        }
+
+        current = &summary.subroutines.insert({name, subroutine}).first->second;
+    }
+    if (depth != 0) return false;
+
+    tokenizer.finish();
+    summary.interfaceHash = interfaceHashOf(summary);
+    return true;
+}
+
+bool ClassIndex::readSummary(const fs::path &file, uint64_t sourceHash, string &className, ClassSummary &summary) {
+    ifstream in (file, ios::binary);
+    char magic[4];
+    if (!in.read(magic, 4) || string(magic, 4) != "JVMI" || in.get() != SUMMARY_VERSION) {
+        return false;
+    }
+
+    uint64_t nSubroutines;
+    if (!getHash(in, summary.sourceHash) || summary.sourceHash != sourceHash ||
+            !getString(in, className) || !getVarint(in, nSubroutines)) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < nSubroutines; i++) {
+        static const Keyword KINDS[] = {Keyword::CONSTRUCTOR, Keyword::FUNCTION, Keyword::METHOD};
+
+        string name;
+        uint64_t kind, nParams;
+        Subroutine subroutine;
+        if (!getString(in, name) || !getVarint(in, kind) || kind > 2 || !getVarint(in, nParams) ||
+                !getString(in, subroutine.returnType) || !getHash(in, subroutine.bodyHash)) {
+            return false;
+        }
+
+        subroutine.kind = KINDS[kind];
+        subroutine.nParams = nParams;
+        summary.subroutines.insert({name, subroutine});
+    }
+
+    summary.interfaceHash = interfaceHashOf(summary);
+    return true;
+}
+
+void ClassIndex::writeSummary(const fs::path &file, const string &className, const ClassSummary &summary) {
+    string out = "JVMI";
+    out.push_back(char(SUMMARY_VERSION));
+    putHash(out, summary.sourceHash);
+    putString(out, className);
+    putVarint(out, summary.subroutines.size());
+
+    for (const auto &[name, subroutine] : summary.subroutines) {
+        putString(out, name);
+        putVarint(out, subroutine.kind == Keyword::CONSTRUCTOR ? 0 : subroutine.kind == Keyword::FUNCTION ? 1 : 2);
+        putVarint(out, subroutine.nParams);
+        putString(out, subroutine.returnType);
+        putHash(out, subroutine.bodyHash);
+    }
+
+    ofstream(file, ios::binary) << out;
+}
+
+// bodies are left out on purpose: no code generation decision in another class depends on them yet
+uint64_t ClassIndex::interfaceHashOf(const ClassSummary &summary) {
+    string signatures;
+    for (const auto &[name, subroutine] : summary.subroutines) {
+        signatures += name + " " + to_string(int(subroutine.kind)) + " " + to_string(subroutine.nParams) +
+                " " + subroutine.returnType + "\n";
+    }
+    return BuildCache::hash(signatures);
+}
+
+/* End Private Methods */
+
+
+
+/* Begin Public Methods */
+
+ClassIndex ClassIndex::build(const vector<fs::path> &files, const vector<string> &sources, ThreadPool &pool,
+        bool useSummaries, bool resident) {
+    typedef pair<string, ClassSummary> Scanned;
+    vector<optional<Scanned>> results(files.size());
+
+    pool.parallelFor(files.size(), [&](size_t i) {
+        FileScope scope (files[i].string());
+        PhaseTimer timer (Phase::INDEX);
+        Scanned scanned;
+        scanned.second.sourceHash = BuildCache::hash(sources[i]);
+
+        if (resident) {
+            lock_guard<mutex> guard(residentLock);
+            if (const auto *result = residentSummaries.find(scanned.second.sourceHash)) {
+                results[i] = *result;
+                return;
+            }
+        }
+
+        fs::path summaryFile = summaryPathOf(files[i]);
+        if (useSummaries && readSummary(summaryFile, scanned.second.sourceHash, scanned.first, scanned.second)) {
+            results[i] = move(scanned);
+            return;
+        }
+
+        istringstream in (sources[i]);
+        try {
+            if (scanClass(in, scanned.first, scanned.second)) {
+                if (useSummaries) {
+                    writeSummary(summaryFile, scanned.first, scanned.second);
+                }
+                if (resident) {
+                    lock_guard<mutex> guard(residentLock);
+                    residentSummaries.insert(scanned.second.sourceHash, scanned);
+                }
+                results[i] = move(scanned);
+            }
+        } catch (...) {
+            // malformed files are left out of the index, the real compile reports the error
+        }
+    });
+
+    // merge in file order so the index doesn't depend on scheduling
+    ClassIndex index;
+    for (auto &result : results) {
+        if (result) {
+            index.classes.insert(move(*result));
+        }
+    }
+
+    return index;
+}
+
+string ClassIndex::update(const string &source) {
+    string className;
+    ClassSummary summary;
+    summary.sourceHash = BuildCache::hash(source);
+
+    istringstream in (source);
+    try {
+        if (!scanClass(in, className, summary)) {
+            return "";
+        }
+    } catch (...) {
+        return "";
+    }
+
+    classes[className] = move(summary);
+    return className;
+}
+
+void ClassIndex::remove(string_view className) {
+    classes.erase(string(className));
+}
+
+bool ClassIndex::hasClass(string_view className) const {
+    return classes.find(string(className)) != classes.end();
+}
+
+vector<string> ClassIndex::classNames() const {
+    vector<string> names;
+    for (const auto &entry : classes) {
+        names.push_back(entry.first);
+    }
+    sort(names.begin(), names.end());
+    return names;
+}
+
+const Subroutine *ClassIndex::find(string_view className, string_view subroutineName) const {
+    auto resultClass = classes.find(string(className));
+    if (resultClass == classes.end()) {
+        return nullptr;
+    }
+
+    auto resultSubroutine = resultClass->second.subroutines.find(string(subroutineName));
+    if (resultSubroutine == resultClass->second.subroutines.end()) {
+        return nullptr;
+    }
+
+    return &resultSubroutine->second;
+}
+
+uint64_t ClassIndex::interfaceHash(string_view className) const {
+    auto resultClass = classes.find(string(className));
+    if (resultClass == classes.end()) {
+        return 0;
+    }
+
+    return resultClass->second.interfaceHash;
+}
+
+/* End Public Methods */
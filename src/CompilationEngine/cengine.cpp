@@ -1,8 +1,12 @@
 #include <CompilationEngine/cengine.hpp>
 #include <SymbolTable/table.hpp>
 #include <SymbolTable/var.hpp>
+#include <TimeReport/report.hpp>
 #include <iostream>
+#include <algorithm>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <stdexcept>
 
@@ -28,6 +32,72 @@ Kind keywordToKind(Keyword key) {
 
 /* Begin Private Methods */
 
+void CompilationEngine::error(const string &message) {
+    throw CompileError(message, tokenizer.line());
+}
+
+bool CompilationEngine::isStatementKeyword() {
+    if (tokenizer.tokenType() != Token::KEYWORD) return false;
+    Keyword key = tokenizer.keyWord();
+    return key == Keyword::LET || key == Keyword::IF || key == Keyword::WHILE ||
+            key == Keyword::DO || key == Keyword::RETURN;
+}
+
+bool CompilationEngine::isSubroutineKeyword() {
+    if (tokenizer.tokenType() != Token::KEYWORD) return false;
+    Keyword key = tokenizer.keyWord();
+    return key == Keyword::CONSTRUCTOR || key == Keyword::FUNCTION || key == Keyword::METHOD;
+}
+
+// skip the rest of a broken statement: past its ';', or up to the next statement
+// or the '}' closing the enclosing block, blocks opened on the way are skipped whole
+void CompilationEngine::synchronizeStatement(size_t start) {
+    size_t depth = 0;
+    if (tokenizer.position() == start) {
+        tokenizer.advance();
+    }
+
+    while (!tokenizer.atEnd()) {
+        try {
+            if (tokenizer.tokenType() == Token::SYMBOL) {
+                char sym = tokenizer.symbol();
+                if (sym == '}' && depth == 0) return;
+                if (sym == '{') depth++;
+                if (sym == '}') depth--;
+                if (sym == ';' && depth == 0) {
+                    tokenizer.advance();
+                    return;
+                }
+            } else if (depth == 0 && isStatementKeyword()) {
+                return;
+            }
+        } catch (CompileError &e) {
+            // invalid tokens are skipped like any other
+        }
+        tokenizer.advance();
+    }
+}
+
+// skip to the next subroutine declaration (or a class variable declaration when those are still expected)
+void CompilationEngine::synchronizeDeclaration(size_t start, bool classVarDec) {
+    if (tokenizer.position() == start) {
+        tokenizer.advance();
+    }
+
+    while (!tokenizer.atEnd()) {
+        try {
+            if (isSubroutineKeyword()) return;
+            if (classVarDec && tokenizer.tokenType() == Token::SYMBOL && tokenizer.symbol() == ';') {
+                tokenizer.advance();
+                return;
+            }
+        } catch (CompileError &e) {
+            // invalid tokens are skipped like any other
+        }
+        tokenizer.advance();
+    }
+}
+
 bool CompilationEngine::isOp(char s) {
     if (s == '+' || s == '-' || s == '*' ||
             s == '/' || s == '&' ||
@@ -48,23 +118,251 @@ bool CompilationEngine::isUnaryOp(char s) {
 string CompilationEngine::keywordToStr(Keyword key) {
     auto result = Tokenizer::KEYWORDMAPPING.right.find(key);
     if (result == Tokenizer::KEYWORDMAPPING.right.end()) {
-        throw runtime_error("Error: Unknown keyword");
+        error("Error: Unknown keyword");
     } else {
         return result->second;
     }
 }
 
+bool CompilationEngine::skipBlock(size_t &ifs, size_t &whiles) {
+    try {
+        if (tokenizer.tokenType() != Token::SYMBOL || tokenizer.symbol() != '{') return false;
+        size_t depth = 0;
+        while (!tokenizer.atEnd()) {
+            Token type = tokenizer.tokenType();
+            if (type == Token::SYMBOL) {
+                char sym = tokenizer.symbol();
+                if (sym == '{') depth++;
+                if (sym == '}' && --depth == 0) {
+                    tokenizer.advance();
+                    return true;
+                }
+            } else if (type == Token::KEYWORD) {
+                ifs += tokenizer.keyWord() == Keyword::IF;
+                whiles += tokenizer.keyWord() == Keyword::WHILE;
+            }
+            tokenizer.advance();
+        }
+    } catch (CompileError &e) {
+        // the compile runs into it as well
+    }
+    return false;
+}
+
 string CompilationEngine::generateLabel() {
     return className + vm.generateLabel();
 }
 
+void CompilationEngine::writeString(const string &str) {
+    // create a string array with the appropriate length
+    vm.writePush(Segment::CONST, str.length());
+    vm.writeCall("String.new", 1);
+
+    // append char to string array
+    for (char c : str) {
+        vm.writePush(Segment::CONST, int(c));
+        vm.writeCall("String.appendChar", 2);
+    }
+}
+
+void CompilationEngine::writeCounter(const string &line) {
+    // two statics, the count is high * 10000 + low, so it's exact up to 327 million and prints in decimal
+    int low = int(sTable.varCount(Kind::STATIC) + 2 * counters.size());
+    int high = low + 1;
+    string done = generateLabel();
+    counters.push_back(line);
+
+    vm.writePush(Segment::STATIC, low);
+    vm.writePush(Segment::CONST, 1);
+    vm.writeArithmetic(Command::ADD);
+    vm.writePop(Segment::STATIC, low);
+    vm.writePush(Segment::STATIC, low);
+    vm.writePush(Segment::CONST, COUNTER_BASE);
+    vm.writeArithmetic(Command::EQ);
+    vm.writeArithmetic(Command::NOT);
+    vm.writeIf(done);
+    vm.writePush(Segment::CONST, 0);
+    vm.writePop(Segment::STATIC, low);
+    vm.writePush(Segment::STATIC, high);
+    vm.writePush(Segment::CONST, 1);
+    vm.writeArithmetic(Command::ADD);
+    vm.writePop(Segment::STATIC, high);
+    vm.writeLabel(done);
+}
+
+void CompilationEngine::writeCounterDump() {
+    auto print = [this](const string &function) {
+        vm.writeCall("Output." + function, 1);
+        vm.writePop(Segment::TEMP, 0);
+    };
+
+    // the string is freed again, a big program has many counters
+    auto printText = [&](const string &text) {
+        writeString(text);
+        vm.writePop(Segment::TEMP, 1);
+        vm.writePush(Segment::TEMP, 1);
+        print("printString");
+        vm.writePush(Segment::TEMP, 1);
+        vm.writeCall("String.dispose", 1);
+        vm.writePop(Segment::TEMP, 0);
+    };
+
+    // Class.$counters prints the hash of every subroutine and every counter of the class, one line each
+    vm.reserveHeader();
+    for (const auto &line : hashes) {
+        printText(line);
+        vm.writeCall("Output.println", 0);
+        vm.writePop(Segment::TEMP, 0);
+    }
+    for (size_t i = 0; i < counters.size(); i++) {
+        printText(counters[i] + " ");
+        int low = int(sTable.varCount(Kind::STATIC) + 2 * i);
+        vm.writePush(Segment::STATIC, low + 1);
+        vm.writePush(Segment::STATIC, low);
+        vm.writeCall(className + "." + COUNTER_DUMP + "$print", 2);
+        vm.writePop(Segment::TEMP, 0);
+        vm.writeCall("Output.println", 0);
+        vm.writePop(Segment::TEMP, 0);
+    }
+    vm.writePush(Segment::CONST, 0);
+    vm.writeReturn();
+    vm.startHeader();
+    vm.writeFunction(className + "." + COUNTER_DUMP, 0);
+    vm.endHeader();
+
+    // Class.$counters$print(high, low) prints one count, the low part with its leading zeros
+    string high = generateLabel();
+    vm.reserveHeader();
+    vm.writePush(Segment::ARG, 0);
+    vm.writeIf(high);
+    vm.writePush(Segment::ARG, 1);
+    print("printInt");
+    vm.writePush(Segment::CONST, 0);
+    vm.writeReturn();
+    vm.writeLabel(high);
+    vm.writePush(Segment::ARG, 0);
+    print("printInt");
+    for (int digits = COUNTER_BASE / 10; digits > 1; digits /= 10) {
+        string wide = generateLabel();
+        vm.writePush(Segment::ARG, 1);
+        vm.writePush(Segment::CONST, digits);
+        vm.writeArithmetic(Command::LT);
+        vm.writeArithmetic(Command::NOT);
+        vm.writeIf(wide);
+        vm.writePush(Segment::CONST, '0');
+        print("printChar");
+        vm.writeLabel(wide);
+    }
+    vm.writePush(Segment::ARG, 1);
+    print("printInt");
+    vm.writePush(Segment::CONST, 0);
+    vm.writeReturn();
+    vm.startHeader();
+    vm.writeFunction(className + "." + COUNTER_DUMP + "$print", 0);
+    vm.endHeader();
+}
+
+bool CompilationEngine::compileSubroutinesInParallel() {
+    // counters and copies of profiled code take labels the parts can't count on
+    if (pool == nullptr || pool->size() < 2 || !errors.empty() || instrumented || profile) {
+        return false;
+    }
+
+    // find where each subroutine starts by following the braces, a label id is handed out twice
+    // per if and while, so the labels each subroutine starts at are known up front as well
+    size_t start = tokenizer.position();
+    vector<size_t> bounds;                      /* start of every subroutine, then the class's closing '}' */
+    vector<size_t> labelBases;
+    try {
+        tokenizer.finish();
+
+        size_t depth = 1;
+        size_t nLabels = 0;
+        while (!tokenizer.atEnd()) {
+            Token type = tokenizer.tokenType();
+            if (type == Token::SYMBOL) {
+                char sym = tokenizer.symbol();
+                if (sym == '{') depth++;
+                if (sym == '}' && --depth == 0) break;
+            } else if (type == Token::KEYWORD && isSubroutineKeyword()) {
+                if (depth != 1) break;
+                bounds.push_back(tokenizer.position());
+                labelBases.push_back(nLabels);
+            } else if (type == Token::KEYWORD && (tokenizer.keyWord() == Keyword::IF || tokenizer.keyWord() == Keyword::WHILE)) {
+                nLabels += 2;
+            }
+
+            if (bounds.empty()) break;
+            tokenizer.advance();
+        }
+
+        bool closed = !tokenizer.atEnd() && tokenizer.tokenType() == Token::SYMBOL && tokenizer.symbol() == '}' && depth == 0;
+        if (!closed || bounds.size() < 2) {
+            tokenizer.seek(start);
+            return false;
+        }
+        bounds.push_back(tokenizer.position());
+    } catch (CompileError &e) {
+        tokenizer.seek(start);
+        return false;
+    }
+
+    typedef struct part_struct {
+        string vm;
+        string xml;
+        set<string> consumed;
+        bool ok = false;
+    } Part;
+
+    // every part works on its own tokens, symbol table and writer, only the index is shared
+    bool printXml = output.rdbuf() != nullptr;
+    vector<Part> parts(labelBases.size());
+    pool->parallelFor(parts.size(), [&](size_t i) {
+        ostringstream vmOut;
+        ostringstream xmlOut;
+        ostream nullout(nullptr);
+        SymbolTable table = sTable;
+
+        CompilationEngine part(tokenizer.slice(bounds[i], bounds[i + 1]), vmOut, printXml ? xmlOut : nullout, table, index, format);
+        part.className = className;
+        part.indent = indent;
+        part.vm.startLabelsAt(labelBases[i]);
+        try {
+            part.compileSubroutineDec();
+            parts[i].ok = part.errors.empty() && part.tokenizer.atEnd();
+        } catch (CompileError &e) {
+            return;
+        }
+
+        part.vm.flush();
+        parts[i].vm = vmOut.str();
+        parts[i].xml = xmlOut.str();
+        parts[i].consumed = move(part.consumed);
+    });
+
+    for (const auto &part : parts) {
+        if (!part.ok) {
+            tokenizer.seek(start);
+            return false;
+        }
+    }
+
+    for (auto &part : parts) {
+        output << part.xml;
+        vm.writeCompiled(part.vm);
+        consumed.insert(part.consumed.begin(), part.consumed.end());
+    }
+    tokenizer.seek(bounds.back());
+    return true;
+}
+
 // handle keyword
 void CompilationEngine::eat(Keyword key) {
     writeIndent();
 
     string keyVal = keywordToStr(key);
     if (tokenizer.tokenType() != Token::KEYWORD || tokenizer.keyWord() != key) {
-        throw runtime_error(string("Error: Unexpected keyword " + keyVal));
+        error(string("Error: Unexpected keyword " + keyVal));
     }
 
     output << "<keyword> " << keyVal << " </keyword>";
@@ -76,7 +374,7 @@ Keyword CompilationEngine::eat(vector<Keyword> possibleKeyword) {
     Keyword key = tokenizer.keyWord();
 
     if (find(possibleKeyword.begin(), possibleKeyword.end(), key) == possibleKeyword.end()) {
-        throw runtime_error("Error: Unexpected keyword " + keywordToStr(key));
+        error("Error: Unexpected keyword " + keywordToStr(key));
     } else {
         eat(key);
         return key;
@@ -88,7 +386,7 @@ void CompilationEngine::eat(char symbol) {
     writeIndent();
 
     if (tokenizer.tokenType() != Token::SYMBOL || tokenizer.symbol() != symbol) {
-        throw runtime_error("Error: Expected symbol " + string(1, symbol));
+        error("Error: Expected symbol " + string(1, symbol));
     }
 
     output << "<symbol> ";
@@ -119,7 +417,7 @@ string CompilationEngine::eat(Token type) {
     writeIndent();
 
     if (tokenizer.tokenType() != type) {
-        throw runtime_error("Error: Unexpected Token");
+        error("Error: Unexpected Token");
     }
 
     switch(type) {
@@ -136,7 +434,7 @@ string CompilationEngine::eat(Token type) {
             output << "<stringConstant> " << value << " </stringConstant>";
             break;
         default:
-            throw runtime_error("Error: expected identifier or constant");
+            error("Error: expected identifier or constant");
             break;
     }
 
@@ -153,12 +451,12 @@ string CompilationEngine::eatType() {
         return ret;
     } else {
         if (tokenizer.tokenType() != Token::KEYWORD) {
-            throw runtime_error("Expected keyword");
+            error("Expected keyword");
         }
 
         Keyword varType = tokenizer.keyWord();
         if (varType != Keyword::INT && varType != Keyword::CHAR && varType != Keyword::BOOLEAN) {
-            throw runtime_error("Expected type keyword");
+            error("Expected type keyword");
         }
 
         string ret = keywordToStr(varType);
@@ -169,9 +467,10 @@ string CompilationEngine::eatType() {
 
 string CompilationEngine::eatSubroutineCall() {
     string callName = eat(Token::IDENTIFIER);
+    const Subroutine *callee = nullptr;
     size_t nArgs = 0;
     if (tokenizer.tokenType() != Token::SYMBOL) {
-        throw runtime_error("Error: Expected . or ( in subroutine call");
+        error("Error: Expected . or ( in subroutine call");
     }
 
     if (tokenizer.symbol() == '.') { /* is it a call to another class? */
@@ -180,28 +479,49 @@ string CompilationEngine::eatSubroutineCall() {
 
         // is it a call to an object's method or a class's function?
         // if it exists in the symbol table, then it is object's method
-        string *objClass = sTable.typeOf(callName);
-        Kind *objKind = sTable.kindOf(callName);
-        size_t *objIndex = sTable.indexOf(callName);
-        if (objClass != nullptr) {
-            callName = *objClass + "." + fnName;
+        Symbol obj = sTable.resolve(callName);
+        string calleeClass = obj ? string(obj.type) : callName;
+        if (calleeClass != className) {
+            consumed.insert(calleeClass);
+        }
+
+        if (obj) {
+            callee = index.find(obj.type, fnName);
+            callName = string(obj.type) + "." + fnName;
             // push object pointer and add nArgs by 1
-            vm.writePush(kindToSegment(*objKind), *objIndex);
+            vm.writePush(obj.segment, obj.index);
             nArgs++;
         } else {
+            callee = index.find(callName, fnName);
+            if (callee != nullptr && callee->kind == Keyword::METHOD) {
+                error("Error: method " + callName + "." + fnName + " called without an object");
+            }
             callName += "." + fnName;
         }
     } else {
+        callee = index.find(className, callName);
+        if (callee == nullptr && index.hasClass(className)) {
+            error("Error: call to undeclared subroutine " + className + "." + callName);
+        }
+
         callName = className + "." + callName;
-        // push the address of this
-        // assume this is a method
-        vm.writePush(Segment::POINTER, 0);
-        nArgs++;
+        // push the address of this, unless the index knows
+        // the subroutine is a function or a constructor
+        if (callee == nullptr || callee->kind == Keyword::METHOD) {
+            vm.writePush(Segment::POINTER, 0);
+            nArgs++;
+        }
     }
 
     eat('(');
-    nArgs += compileExpressionList();
+    size_t nExpressions = compileExpressionList();
+    nArgs += nExpressions;
     eat(')');
+
+    if (callee != nullptr && callee->nParams != nExpressions) {
+        error("Error: " + callName + " expects " + to_string(callee->nParams) +
+                " arguments, got " + to_string(nExpressions));
+    }
     
     // write code for function calls
     vm.writeCall(callName, nArgs);
@@ -232,36 +552,82 @@ void CompilationEngine::writeIndent() {
 /* Begin Public Methods */
 
 void CompilationEngine::compileClass() {
+    PhaseTimer timer (Phase::PARSE);
     sTable.startClass();
+    errors.clear();
 
-    eatBegin("class");
-    eat(Keyword::CLASS);
-    className = tokenizer.identifier();
-    eat(Token::IDENTIFIER);
-    eat('{');
+    try {
+        eatBegin("class");
+        eat(Keyword::CLASS);
+        className = tokenizer.identifier();
+        eat(Token::IDENTIFIER);
+        eat('{');
 
-    // 0 or more class variable declaration
-    while (true) {
-        Token type = tokenizer.tokenType();
-        if (type != Token::KEYWORD) break;
-        Keyword key = tokenizer.keyWord();
-        if (key != Keyword::STATIC && key != Keyword::FIELD) break;
+        // 0 or more class variable declaration
+        while (!tokenizer.atEnd()) {
+            size_t start = tokenizer.position();
+            size_t savedIndent = indent;
+            try {
+                Token type = tokenizer.tokenType();
+                if (type != Token::KEYWORD) break;
+                Keyword key = tokenizer.keyWord();
+                if (key != Keyword::STATIC && key != Keyword::FIELD) break;
+
+                compileClassVarDec();
+            } catch (CompileError &e) {
+                errors.push_back(e);
+                indent = savedIndent;
+                synchronizeDeclaration(start, true);
+            }
+        }
 
-        compileClassVarDec();
-    }
+        // 0 or more subroutine declaration
+        bool compiledInParallel = compileSubroutinesInParallel();
+        while (!compiledInParallel && !tokenizer.atEnd()) {
+            size_t start = tokenizer.position();
+            size_t savedIndent = indent;
+            try {
+                Token type = tokenizer.tokenType();
+                if (type != Token::KEYWORD && type != Token::IDENTIFIER) break;
+
+                compileSubroutineDec();
+                if (subroutineDone && errors.empty()) {
+                    vm.flush();
+                    subroutineDone();
+                }
+            } catch (CompileError &e) {
+                errors.push_back(e);
+                indent = savedIndent;
+                synchronizeDeclaration(start, false);
+            }
+        }
 
-    // 0 or more subroutine declaration
-    while (true) {
-        Token type = tokenizer.tokenType();
-        if (type != Token::KEYWORD && type != Token::IDENTIFIER) break;
+        // recovery may already have run into the end of the file
+        if (errors.empty() || !tokenizer.atEnd()) {
+            eat('}');
+        }
+        eatEnd("class");
 
-        compileSubroutineDec();
+        if (instrumented && errors.empty()) {
+            writeCounterDump();
+        }
+    } catch (CompileError &e) {
+        errors.push_back(e);
     }
 
-    eat('}');
-    eatEnd("class");
-
+    // a pipelined lexer reports a lexical error only now, it replaces whatever the parser ran into after it
+    tokenizer.finish();
+    if (PhaseTimes *times = TimeReport::current()) {
+        times->tokens += tokenizer.size();
+    }
     sTable.printClassTable();
+    vm.flush();
+
+    if (!errors.empty()) {
+        // a branch laid out by the profile is compiled out of source order
+        stable_sort(errors.begin(), errors.end(), [](const CompileError &a, const CompileError &b) { return a.line() < b.line(); });
+        throw CompileErrors(errors);
+    }
 }
 
 void CompilationEngine::compileClassVarDec() {
@@ -291,9 +657,11 @@ void CompilationEngine::compileSubroutineDec() {
     // Parse
     eatBegin("subroutineDec");
 
-    // clear subroutine table and switch vm writer buffer to string buffer
+    // clear subroutine table and keep room for the function header, the body comes first
     sTable.startSubroutine();
-    vm.switchBuffer(Buffer::STRING);
+    vm.reserveHeader();
+    nLoops = 0;
+    nIfs = 0;
 
     // ( 'constructor' | 'function' | 'method' )
     Keyword ftype = eat(vector<Keyword> {Keyword::CONSTRUCTOR, Keyword::FUNCTION, Keyword::METHOD});
@@ -310,7 +678,14 @@ void CompilationEngine::compileSubroutineDec() {
         sTable.define("this", className, Kind::ARG);
     }
 
-    string subroutineName = eat(Token::IDENTIFIER);
+    subroutineName = eat(Token::IDENTIFIER);
+    const Subroutine *declared = index.find(className, subroutineName);
+    hot = profile && declared && !instrumented ? profile->find(className + "." + subroutineName, declared->bodyHash) : nullptr;
+    if (instrumented && declared) {
+        ostringstream line;
+        line << "hash " << className << "." << subroutineName << " " << hex << setw(16) << setfill('0') << declared->bodyHash;
+        hashes.push_back(line.str());
+    }
     eat('(');
     compileParameterList();
     eat(')');
@@ -322,7 +697,7 @@ void CompilationEngine::compileSubroutineDec() {
 
     
     // Write code
-    vm.switchBuffer(Buffer::FILE);
+    vm.startHeader();
     // declare function
     vm.writeFunction(className + "." + subroutineName, sTable.varCount(Kind::VAR));
     switch(ftype) {
@@ -341,9 +716,12 @@ void CompilationEngine::compileSubroutineDec() {
         default:
             break;
     }
+    if (instrumented) {
+        writeCounter("function " + className + "." + subroutineName);
+    }
 
-    // write body
-    vm.writeNow();
+    // the body is already in place behind the header
+    vm.endHeader();
 }
 
 void CompilationEngine::compileParameterList() {
@@ -417,25 +795,35 @@ void CompilationEngine::compileStatements() {
     eatBegin("statements");
 
     while (tokenizer.tokenType() == Token::KEYWORD) {
-        switch(tokenizer.keyWord()) {
-            case Keyword::LET:
-                compileLet();
-                break;
-            case Keyword::IF:
-                compileIf();
-                break;
-            case Keyword::WHILE:
-                compileWhile();
-                break;
-            case Keyword::DO:
-                compileDo();
-                break;
-            case Keyword::RETURN:
-                compileReturn();
-                break;
-            default:
-                throw runtime_error("Error: Invalid statement");
-                break;
+        size_t start = tokenizer.position();
+        size_t savedIndent = indent;
+        try {
+            switch(tokenizer.keyWord()) {
+                case Keyword::LET:
+                    compileLet();
+                    break;
+                case Keyword::IF:
+                    compileIf();
+                    break;
+                case Keyword::WHILE:
+                    compileWhile();
+                    break;
+                case Keyword::DO:
+                    compileDo();
+                    break;
+                case Keyword::RETURN:
+                    compileReturn();
+                    break;
+                default:
+                    error("Error: Invalid statement");
+                    break;
+            }
+        } catch (CompileError &e) {
+            // record the error and carry on with the next statement
+            errors.push_back(e);
+            indent = savedIndent;
+            synchronizeStatement(start);
+            if (tokenizer.atEnd()) break;
         }
     }
 
@@ -450,17 +838,15 @@ void CompilationEngine::compileLet() {
     eat(Keyword::LET);
     string varName = eat(Token::IDENTIFIER);
 
-    string *varType = sTable.typeOf(varName);
-    Kind *varKind = sTable.kindOf(varName);
-    size_t *varIndex = sTable.indexOf(varName);
-    if (varType == nullptr || varKind == nullptr || varIndex == nullptr) {
-        throw runtime_error(string("use of undeclared variable " + varName));
+    Symbol var = sTable.resolve(varName);
+    if (!var) {
+        error(string("use of undeclared variable " + varName));
     }
 
     // handle possibility of an array
     if (tokenizer.tokenType() == Token::SYMBOL && tokenizer.symbol() == '[') {
         accessingArray = true;
-        vm.writePush(kindToSegment(*varKind), *varIndex);
+        vm.writePush(var.segment, var.index);
 
         eat('[');
         compileExpression();
@@ -479,7 +865,7 @@ void CompilationEngine::compileLet() {
         vm.writePush(Segment::TEMP, 0);
         vm.writePop(Segment::THAT, 0);
     } else {
-        vm.writePop(kindToSegment(*varKind), *varIndex);
+        vm.writePop(var.segment, var.index);
     }
 
     eatEnd("letStatement");
@@ -494,12 +880,64 @@ void CompilationEngine::compileIf() {
     eat(Keyword::IF);
     eat('(');
     compileExpression();
+    eat(')');
+
+    // the profile says the else branch runs more often, it goes first and the then branch after it
+    size_t branch = nIfs++;
+    bool elseIsHot = false;
+    if (hot && output.rdbuf() == nullptr) {
+        auto counts = hot->branches.find(branch);
+        elseIsHot = counts != hot->branches.end() && counts->second.second > counts->second.first;
+    }
+    if (elseIsHot) {
+        size_t thenStart = tokenizer.position();
+        size_t ifsBefore = nIfs;
+        size_t loopsBefore = nLoops;
+        size_t thenIfs = 0;
+        size_t thenWhiles = 0;
+        if (skipBlock(thenIfs, thenWhiles) && tokenizer.tokenType() == Token::KEYWORD && tokenizer.keyWord() == Keyword::ELSE) {
+            // ifs and whiles keep their source order numbers
+            nIfs += thenIfs;
+            nLoops += thenWhiles;
+            // the then branch runs only for true (-1), ~cond == 0, any other value still takes the else branch
+            vm.writeArithmetic(Command::NOT);
+            vm.writePush(Segment::CONST, 0);
+            vm.writeArithmetic(Command::EQ);
+            vm.writeIf(label1);
+            eat(Keyword::ELSE);
+            eat('{');
+            compileStatements();
+            eat('}');
+            vm.writeGoto(label2);
+
+            size_t end = tokenizer.position();
+            size_t ifsAfter = nIfs;
+            size_t loopsAfter = nLoops;
+            tokenizer.seek(thenStart);
+            nIfs = ifsBefore;
+            nLoops = loopsBefore;
+            vm.writeLabel(label1);
+            eat('{');
+            compileStatements();
+            eat('}');
+            tokenizer.seek(end);
+            nIfs = ifsAfter;
+            nLoops = loopsAfter;
+
+            vm.writeLabel(label2);
+            eatEnd("ifStatement");
+            return;
+        }
+        tokenizer.seek(thenStart);
+    }
 
     vm.writeArithmetic(Command::NOT);
     vm.writeIf(label1);
 
-    eat(')');
     eat('{');
+    if (instrumented) {
+        writeCounter("then " + className + "." + subroutineName + " " + to_string(branch));
+    }
     compileStatements();
 
     vm.writeGoto(label2);
@@ -507,6 +945,9 @@ void CompilationEngine::compileIf() {
     eat('}');
 
     vm.writeLabel(label1);
+    if (instrumented) {
+        writeCounter("else " + className + "." + subroutineName + " " + to_string(branch));
+    }
 
     // handle possibility of an else statement
     if (tokenizer.tokenType() == Token::KEYWORD && tokenizer.keyWord() == Keyword::ELSE) {
@@ -531,15 +972,50 @@ void CompilationEngine::compileWhile() {
 
     eat(Keyword::WHILE);
     eat('(');
+    size_t condition = tokenizer.position();
     compileExpression();
     eat(')');
 
     vm.writeArithmetic(Command::NOT);
     vm.writeIf(label2);
 
+    size_t loop = nLoops++;
+    size_t ifsBefore = nIfs;
+    size_t loopsBefore = nLoops;
+    size_t nErrors = errors.size();
     eat('{');
     compileStatements();
     eat('}');
+    // the back edge, once per iteration
+    if (instrumented) {
+        writeCounter("loop " + className + "." + subroutineName + " " + to_string(loop));
+    }
+
+    // a small loop the profile says runs many times per call gets a second copy of its test
+    // and body, one jump back for every two iterations
+    bool unroll = false;
+    if (hot && output.rdbuf() == nullptr && errors.size() == nErrors && tokenizer.position() - condition <= UNROLL_MAX_TOKENS) {
+        auto iterations = hot->loops.find(loop);
+        unroll = iterations != hot->loops.end() && iterations->second >= UNROLL_MIN_ITERATIONS * max<uint64_t>(hot->calls, 1);
+    }
+    if (unroll) {
+        size_t end = tokenizer.position();
+        size_t ifsAfter = nIfs;
+        size_t loopsAfter = nLoops;
+        tokenizer.seek(condition);
+        nIfs = ifsBefore;
+        nLoops = loopsBefore;
+        compileExpression();
+        eat(')');
+        vm.writeArithmetic(Command::NOT);
+        vm.writeIf(label2);
+        eat('{');
+        compileStatements();
+        eat('}');
+        tokenizer.seek(end);
+        nIfs = ifsAfter;
+        nLoops = loopsAfter;
+    }
     vm.writeGoto(label1);
 
     vm.writeLabel(label2);
@@ -573,6 +1049,13 @@ void CompilationEngine::compileReturn() {
     }
     eat(';');
 
+    // the program ends when Main.main returns
+    if (instrumented && className == "Main" && subroutineName == "main") {
+        for (const auto &name : index.classNames()) {
+            vm.writeCall(name + "." + COUNTER_DUMP, 0);
+            vm.writePop(Segment::TEMP, 0);
+        }
+    }
     vm.writeReturn();
 
     eatEnd("returnStatement");
@@ -614,20 +1097,7 @@ void CompilationEngine::compileTerm() {
             break;
         }
         case Token::STRING_CONST: {
-            string str = eat(Token::STRING_CONST);
-            size_t strlen = str.length();
-            
-            // create a string array with the appropriate length
-            vm.writePush(Segment::CONST, strlen);
-            vm.writeCall("String.new", 1);
-
-            // append char to string array
-            for (size_t i = 0; i < strlen; i++) {
-                // push char c
-                vm.writePush(Segment::CONST, int(str[i]));
-                // call String.appendChar
-                vm.writeCall("String.appendChar", 2);
-            }
+            writeString(eat(Token::STRING_CONST));
             break;
         }
         case Token::IDENTIFIER: {
@@ -643,16 +1113,14 @@ void CompilationEngine::compileTerm() {
                     tokenizer.backtrack();
 
                     string arrName = eat(Token::IDENTIFIER);
-                    string *arrType = sTable.typeOf(arrName);
-                    Kind *arrKind = sTable.kindOf(arrName);
-                    size_t *arrLocation = sTable.indexOf(arrName);
+                    Symbol arr = sTable.resolve(arrName);
 
                     // Error checking
-                    if (arrType == nullptr || arrKind == nullptr || arrLocation == nullptr) {
-                        throw runtime_error(string("Use of undeclared array " + arrName));
+                    if (!arr) {
+                        error(string("Use of undeclared array " + arrName));
                     }
 
-                    vm.writePush(kindToSegment(*arrKind), *arrLocation);
+                    vm.writePush(arr.segment, arr.index);
 
                     eat('[');
                     compileExpression();
@@ -671,13 +1139,12 @@ void CompilationEngine::compileTerm() {
             string varName = eat(Token::IDENTIFIER);
 
             // get the location of variable in memory
-            size_t *varIndex = sTable.indexOf(varName);
-            Kind *varKind = sTable.kindOf(varName);
-            if (varIndex == nullptr) {
-                throw runtime_error(string("Undeclared variable: " + varName));
+            Symbol var = sTable.resolve(varName);
+            if (!var) {
+                error(string("Undeclared variable: " + varName));
             }
             // write the code to push the variable
-            vm.writePush(kindToSegment(*varKind), *varIndex);
+            vm.writePush(var.segment, var.index);
 
             break;
         }
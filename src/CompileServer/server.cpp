@@ -0,0 +1,302 @@
+#include <CompileServer/server.hpp>
+#include <BuildCache/cache.hpp>
+#include <ClassIndex/index.hpp>
+#include <JackAnalyzer/analyzer.hpp>
+#include <TimeReport/alloc.hpp>
+#include <TimeReport/report.hpp>
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+/* Begin Helper Function */
+
+static bool makeAddress(const string &socketPath, sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path too long: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    return true;
+}
+
+// applies the options of a request, returns false on an unknown one
+static bool applyOptions(istringstream &options) {
+    JackAnalyzer::printXml = false;
+    JackAnalyzer::useCache = false;
+    JackAnalyzer::cacheDir.clear();
+    JackAnalyzer::pipelinedLexer = false;
+    JackAnalyzer::parallelSubroutines = false;
+    JackAnalyzer::vmFormat = VMFormat::TEXT;
+    JackAnalyzer::emitAsm = false;
+    JackAnalyzer::emitC = false;
+    JackAnalyzer::instrument = false;
+    JackAnalyzer::profile = Profile();
+    JackAnalyzer::runProgram = false;
+    TimeReport::enabled = false;
+    TimeReport::json = false;
+    AllocationCounter::counting = false;
+    AllocationCounter::json = false;
+
+    string option;
+    while (options >> option) {
+        if (option == "--print-xml") {
+            JackAnalyzer::printXml = true;
+        } else if (option == "--cache") {
+            JackAnalyzer::useCache = true;
+        } else if (option.rfind("--cache-dir=", 0) == 0) {
+            JackAnalyzer::useCache = true;
+            JackAnalyzer::cacheDir = option.substr(string("--cache-dir=").size());
+        } else if (option == "--pipeline-lexer") {
+            JackAnalyzer::pipelinedLexer = true;
+        } else if (option == "--parallel-subroutines") {
+            JackAnalyzer::parallelSubroutines = true;
+        } else if (option == "--binary") {
+            JackAnalyzer::vmFormat = VMFormat::BINARY;
+        } else if (option == "--asm") {
+            JackAnalyzer::emitAsm = true;
+        } else if (option == "--c") {
+            JackAnalyzer::emitC = true;
+        } else if (option == "--instrument") {
+            JackAnalyzer::instrument = true;
+        } else if (option.rfind("--profile=", 0) == 0) {
+            string file = option.substr(string("--profile=").size());
+            if (!Profile::read(file, JackAnalyzer::profile)) {
+                *JackAnalyzer::diagnostics << "Warning: can't read the profile " << file << ", compiling without it" << endl;
+            }
+        } else if (option == "--time-report" || option == "--time-report=json") {
+            TimeReport::enabled = true;
+            TimeReport::json = option == "--time-report=json";
+        } else if (option == "--alloc-report" || option == "--alloc-report=json") {
+            AllocationCounter::counting = true;
+            AllocationCounter::json = option == "--alloc-report=json";
+        } else if (option == "--run") {
+            JackAnalyzer::runProgram = true;
+        } else {
+            *JackAnalyzer::diagnostics << "Unknown option " << option << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* End Helper Function */
+
+
+
+/* Begin Private Methods */
+
+bool CompileServer::readRequest(int fd, string &header, string &payload, string &problem) {
+    // read in blocks, what follows the header line is the start of the payload
+    string received;
+    vector<char> buffer(READ_SIZE);
+    size_t newline;
+    while ((newline = received.find('\n')) == string::npos && received.size() <= MAX_HEADER) {
+        ssize_t n = read(fd, buffer.data(), buffer.size());
+        if (n <= 0) return false;
+        received.append(buffer.data(), n);
+    }
+    if (newline == string::npos || newline > MAX_HEADER) {
+        problem = "Request header longer than " + to_string(MAX_HEADER) + " bytes";
+        return true;
+    }
+    header = received.substr(0, newline);
+
+    // only SOURCE requests carry a payload
+    if (header.rfind("SOURCE ", 0) != 0) {
+        return true;
+    }
+
+    size_t size;
+    const char *first = header.data() + 7;
+    const char *last = header.data() + header.size();
+    auto [end, error] = from_chars(first, last, size);
+    if (error != errc() || end == first || (end != last && *end != ' ')) {
+        problem = "Malformed payload size in \"" + header + "\"";
+        return true;
+    }
+    if (size > MAX_PAYLOAD) {
+        problem = "Payload of " + to_string(size) + " bytes exceeds the limit of " + to_string(MAX_PAYLOAD);
+        return true;
+    }
+
+    payload = received.substr(newline + 1, size);
+    size_t got = payload.size();
+    payload.resize(size);
+    while (got < size) {
+        ssize_t n = read(fd, payload.data() + got, size - got);
+        if (n <= 0) return false;
+        got += n;
+    }
+
+    return true;
+}
+
+bool CompileServer::sendAll(int fd, const string &data) {
+    for (size_t sent = 0; sent < data.size();) {
+        ssize_t n = write(fd, data.data() + sent, data.size() - sent);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+bool CompileServer::handle(int fd) {
+    string header, payload, problem;
+    if (!readRequest(fd, header, payload, problem)) {
+        return true;
+    }
+    if (!problem.empty()) {
+        problem += "\n";
+        sendAll(fd, "ERROR " + to_string(problem.size()) + "\n" + problem);
+        return true;
+    }
+
+    istringstream request(header);
+    string command;
+    request >> command;
+
+    if (command == "SHUTDOWN") {
+        sendAll(fd, "OK 0\n");
+        return false;
+    }
+
+    ostringstream output;
+    JackAnalyzer::console = &output;
+    JackAnalyzer::diagnostics = &output;
+
+    bool ok = false;
+    try {
+        if (command == "COMPILE") {
+            string path;
+            request >> quoted(path);
+            ok = applyOptions(request) && JackAnalyzer::analyze(path);
+        } else if (command == "SOURCE") {
+            size_t size;
+            request >> size;
+            if (applyOptions(request)) {
+                JackAnalyzer::compileSource(payload, output);
+                ok = true;
+            }
+        } else {
+            output << "Unknown request " << command << endl;
+        }
+    } catch (exception &e) {
+        output << e.what() << endl;
+    } catch (const char *e) {
+        output << e << endl;
+    } catch (string &e) {
+        output << e << endl;
+    } catch (...) {
+        output << "Unknown error" << endl;
+    }
+
+    JackAnalyzer::console = &cout;
+    JackAnalyzer::diagnostics = &cerr;
+
+    string reply = output.str();
+    sendAll(fd, string(ok ? "OK " : "ERROR ") + to_string(reply.size()) + "\n" + reply);
+    return true;
+}
+
+/* End Private Methods */
+
+
+
+/* Begin Public Methods */
+
+int CompileServer::serve(const string &socketPath) {
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address)) {
+        return 1;
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socketPath.c_str());
+    if (listener < 0 || bind(listener, (sockaddr *) &address, sizeof(address)) < 0 || listen(listener, 64) < 0) {
+        cerr << "Cannot listen on " << socketPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    // a client going away mid reply must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    JackAnalyzer::keepResident = true;
+
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        // a read or write that waits longer fails and the client is dropped
+        timeval idle {IDLE_SECONDS, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+
+        bool running = handle(client);
+        close(client);
+        if (!running) break;
+    }
+
+    close(listener);
+    unlink(socketPath.c_str());
+    return 0;
+}
+
+int CompileServer::forward(const string &socketPath, const string &header, const string &payload) {
+    sockaddr_un address;
+    if (!makeAddress(socketPath, address)) {
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *) &address, sizeof(address)) < 0) {
+        cerr << "Cannot connect to " << socketPath << ": " << strerror(errno) << endl;
+        return 1;
+    }
+
+    if (!sendAll(fd, header + "\n" + payload)) {
+        close(fd);
+        return 1;
+    }
+
+    // "OK <size>\n" or "ERROR <size>\n", then the output, the output of a failed request is its errors
+    string status;
+    vector<char> buffer(READ_SIZE);
+    bool inStatus = true;
+    ssize_t n;
+    while ((n = read(fd, buffer.data(), buffer.size())) > 0) {
+        const char *start = buffer.data();
+        const char *end = buffer.data() + n;
+        if (inStatus) {
+            const char *newline = find(start, end, '\n');
+            status.append(start, newline);
+            if (newline == end) continue;
+            inStatus = false;
+            start = newline + 1;
+        }
+        (status.rfind("OK ", 0) == 0 ? cout : cerr).write(start, end - start);
+    }
+    close(fd);
+
+    return status.rfind("OK ", 0) == 0 ? 0 : 1;
+}
+
+/* End Public Methods */
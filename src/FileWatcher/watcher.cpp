@@ -0,0 +1,80 @@
+#include <FileWatcher/watcher.hpp>
+#include <algorithm>
+#include <string>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <boost/algorithm/string/predicate.hpp>
+
+using namespace std;
+namespace fs = filesystem;
+
+
+FileWatcher::FileWatcher(const fs::path &watchedDir) : dir {watchedDir} {
+    fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM;
+    if (inotify_add_watch(fd, dir.c_str(), mask) < 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+vector<fs::path> FileWatcher::wait() {
+    vector<fs::path> changed;
+    alignas(inotify_event) char buffer[64 * 1024];
+    lost = false;
+
+    while (changed.empty() && !lost) {
+        // block for the first event, then drain whatever else is already queued
+        pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            return changed;
+        }
+
+        while (true) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n <= 0) {
+                return changed;
+            }
+
+            for (char *p = buffer; p < buffer + n;) {
+                inotify_event *event = reinterpret_cast<inotify_event *>(p);
+                p += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW) {
+                    lost = true;
+                    continue;
+                }
+
+                // IN_CREATE alone means an empty new file, its content comes with IN_CLOSE_WRITE
+                if (event->len == 0 || event->mask == IN_CREATE) continue;
+                string name = event->name;
+                if (!boost::algorithm::ends_with(name, ".jack")) continue;
+
+                fs::path file = dir / name;
+                if (find(changed.begin(), changed.end(), file) == changed.end()) {
+                    changed.push_back(file);
+                }
+            }
+
+            pollfd more = {fd, POLLIN, 0};
+            if (poll(&more, 1, 0) <= 0) {
+                break;
+            }
+        }
+    }
+
+    sort(changed.begin(), changed.end());
+    return changed;
+}
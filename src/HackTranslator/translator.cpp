@@ -0,0 +1,493 @@
+#include <HackTranslator/translator.hpp>
+
+using namespace std;
+
+
+/* Begin Helper Function */
+
+// base pointer of the segments that have one
+static string_view baseOf(Segment segment) {
+    switch (segment) {
+        case Segment::LOCAL:
+            return "LCL";
+        case Segment::ARG:
+            return "ARG";
+        case Segment::THIS:
+            return "THIS";
+        case Segment::THAT:
+            return "THAT";
+        default:
+            return "";
+    }
+}
+
+static bool isBinary(Command command) {
+    return command != Command::NEG && command != Command::NOT;
+}
+
+static bool isCompare(Command command) {
+    return command == Command::EQ || command == Command::GT || command == Command::LT;
+}
+
+// gt and lt can't subtract: x - y overflows 16 bits when the signs differ
+static bool isOrdering(Command command) {
+    return command == Command::GT || command == Command::LT;
+}
+
+// jump taken when x command y holds, D has the sign of x - y
+static string_view jumpOf(Command command, bool negated) {
+    switch (command) {
+        case Command::EQ:
+            return negated ? "D;JNE" : "D;JEQ";
+        case Command::GT:
+            return negated ? "D;JLE" : "D;JGT";
+        default:
+            return negated ? "D;JGE" : "D;JLT";
+    }
+}
+
+/* End Helper Function */
+
+
+/* Begin Private Methods */
+
+void HackTranslator::emit(string_view instruction) {
+    out.append(instruction).push_back('\n');
+    nInstructions++;
+}
+
+void HackTranslator::emitLabel(string_view label) {
+    out.append("(").append(label).append(")\n");
+}
+
+void HackTranslator::spill() {
+    if (cached) {
+        emit("@SP");
+        emit("AM=M+1");
+        emit("A=A-1");
+        emit("M=D");
+        cached = false;
+    }
+}
+
+void HackTranslator::load() {
+    if (!cached) {
+        emit("@SP");
+        emit("AM=M-1");
+        emit("D=M");
+        cached = true;
+    }
+}
+
+// static, temp and pointer are fixed addresses, the others step A from the base up to maxSteps times
+bool HackTranslator::selectAddress(Segment segment, uint32_t index, uint32_t maxSteps) {
+    switch (segment) {
+        case Segment::STATIC:
+            emit("@" + fileName + "." + to_string(index));
+            return true;
+        case Segment::TEMP:
+            emit("@" + to_string(5 + index));
+            return true;
+        case Segment::POINTER:
+            emit(index == 0 ? "@THIS" : "@THAT");
+            return true;
+        case Segment::CONST:
+            return false;
+        default:
+            if (index > maxSteps) return false;
+            emit("@" + string(baseOf(segment)));
+            emit(index == 0 ? "A=M" : "A=M+1");
+            for (uint32_t i = 1; i < index; i++) {
+                emit("A=A+1");
+            }
+            return true;
+    }
+}
+
+void HackTranslator::pushToD(Segment segment, uint32_t index) {
+    if (segment == Segment::CONST) {
+        if (index <= 1) {
+            emit(index == 0 ? "D=0" : "D=1");
+        } else {
+            emit("@" + to_string(index));
+            emit("D=A");
+        }
+    } else if (selectAddress(segment, index, 2)) {
+        emit("D=M");
+    } else {
+        emit("@" + string(baseOf(segment)));
+        emit("D=M");
+        emit("@" + to_string(index));
+        emit("A=D+A");
+        emit("D=M");
+    }
+}
+
+void HackTranslator::popFromD(Segment segment, uint32_t index) {
+    if (segment == Segment::CONST) {
+        return;
+    }
+    if (selectAddress(segment, index, 4)) {
+        emit("M=D");
+        return;
+    }
+
+    // D = value + address, then A = D - value and M = D - A, only R13 is needed
+    emit("@R13");
+    emit("M=D");
+    emit("@" + string(baseOf(segment)));
+    emit("D=D+M");
+    emit("@" + to_string(index));
+    emit("D=D+A");
+    emit("@R13");
+    emit("A=D-M");
+    emit("M=D-A");
+}
+
+// x is in D, applies command with y taken from where it lives, false if y needs D to be reached
+bool HackTranslator::binaryWithOperand(const Instruction &operand, Command command) {
+    Segment segment = Segment(operand.kind);
+    bool isConst = segment == Segment::CONST;
+    if (isConst) {
+        if (operand.operand == 0 && command != Command::AND) {
+            return true;                            /* x + 0, x - 0, x | 0 and x compared to 0 are x */
+        }
+        if (operand.operand == 1 && (command == Command::ADD || command == Command::SUB)) {
+            emit(command == Command::ADD ? "D=D+1" : "D=D-1");
+            return true;
+        }
+        if (isOrdering(command)) {
+            // a constant is 0..32767, only a negative x can overflow and then x < y whatever y is
+            string id = to_string(uniq++);
+            emit("@$SIGNED." + id);
+            emit("D;JLT");
+            emit("@" + to_string(operand.operand));
+            emit("D=D-A");
+            emitLabel("$SIGNED." + id);
+            return true;
+        }
+        emit("@" + to_string(operand.operand));
+    } else if (isOrdering(command)) {
+        emit("@R13");
+        emit("M=D");
+        pushToD(segment, operand.operand);
+        emit("@R14");
+        emit("M=D");
+        compare();
+        return true;
+    } else if (!selectAddress(segment, operand.operand, 6)) {
+        return false;
+    }
+
+    char y = isConst ? 'A' : 'M';
+    switch (command) {
+        case Command::ADD:
+            emit(string("D=D+") + y);
+            break;
+        case Command::AND:
+            emit(string("D=D&") + y);
+            break;
+        case Command::OR:
+            emit(string("D=D|") + y);
+            break;
+        default:
+            emit(string("D=D-") + y);            /* sub, and x - y for a comparison */
+            break;
+    }
+    return true;
+}
+
+// D = sign of x - y for x in R13 and y in R14, through the shared $COMPARE routine
+void HackTranslator::compare() {
+    string returnLabel = function + "$cmp." + to_string(uniq++);
+    emit("@" + returnLabel);
+    emit("D=A");
+    emit("@$COMPARE");
+    emit("0;JMP");
+    emitLabel(returnLabel);
+    compares = true;
+}
+
+// D has the sign of x - y for the comparison at k, returns how many of the following instructions were folded in
+size_t HackTranslator::finishCompare(const vector<Instruction> &code, size_t k, Command command, const VMProgram &program) {
+    bool negated = k + 2 < code.size() && code[k + 1].opcode == Opcode::ARITHMETIC
+            && Command(code[k + 1].kind) == Command::NOT && code[k + 2].opcode == Opcode::IF_GOTO;
+    size_t jump = negated ? k + 2 : k + 1;
+    if (jump < code.size() && code[jump].opcode == Opcode::IF_GOTO) {
+        emit("@" + scoped(program.names[code[jump].name]));
+        emit(jumpOf(command, negated));
+        cached = false;
+        return jump - k;
+    }
+
+    string id = to_string(uniq++);
+    emit("@$TRUE." + id);
+    emit(jumpOf(command, false));
+    emit("D=0");
+    emit("@$END." + id);
+    emit("0;JMP");
+    emitLabel("$TRUE." + id);
+    emit("D=-1");
+    emitLabel("$END." + id);
+    return 0;
+}
+
+// the return address goes in D and the callee in R13, the trampoline builds the frame
+void HackTranslator::call(const string &name, uint32_t nArgs) {
+    string returnLabel = function + "$ret." + to_string(uniq++);
+    emit("@" + name);
+    emit("D=A");
+    emit("@R13");
+    emit("M=D");
+    emit("@" + returnLabel);
+    emit("D=A");
+    emit("@$CALL." + to_string(nArgs));
+    emit("0;JMP");
+    emitLabel(returnLabel);
+    callArities.insert(nArgs);
+    cached = true;
+}
+
+string HackTranslator::scoped(const string &label) const {
+    return function + "$" + label;
+}
+
+/* End Private Methods */
+
+
+HackTranslator::HackTranslator() {
+    out.reserve(1 << 20);
+    emit("@256");
+    emit("D=A");
+    emit("@SP");
+    emit("M=D");
+    function = "$BOOT";
+    call("Sys.init", 0);
+    emit("@$BOOT$ret.0");
+    emit("0;JMP");
+    cached = false;
+}
+
+void HackTranslator::translate(const VMProgram &program, const string &file) {
+    fileName = file;
+    const auto &code = program.code;
+    for (size_t k = 0; k < code.size(); k++) {
+        const Instruction &instruction = code[k];
+        switch (instruction.opcode) {
+            case Opcode::PUSH: {
+                // push y followed by a binary operation, x stays in D and y is used in place
+                bool fused = false;
+                if (cached && k + 1 < code.size() && code[k + 1].opcode == Opcode::ARITHMETIC && isBinary(Command(code[k + 1].kind))) {
+                    Command command = Command(code[k + 1].kind);
+                    fused = binaryWithOperand(instruction, command);
+                    if (fused) {
+                        k++;
+                        if (isCompare(command)) {
+                            k += finishCompare(code, k, command, program);
+                        }
+                    }
+                }
+                if (!fused) {
+                    spill();
+                    pushToD(Segment(instruction.kind), instruction.operand);
+                    cached = true;
+                }
+                break;
+            }
+            case Opcode::POP:
+                load();
+                popFromD(Segment(instruction.kind), instruction.operand);
+                cached = false;
+                break;
+            case Opcode::ARITHMETIC: {
+                Command command = Command(instruction.kind);
+                load();
+                if (command == Command::NEG) {
+                    emit("D=-D");
+                } else if (command == Command::NOT) {
+                    if (k + 1 < code.size() && code[k + 1].opcode == Opcode::IF_GOTO) {
+                        // not; if-goto jumps unless D is true (-1), D isn't known to be 0 or -1 here
+                        emit("D=D+1");
+                        emit("@" + scoped(program.names[code[++k].name]));
+                        emit("D;JNE");
+                        cached = false;
+                    } else {
+                        emit("D=!D");
+                    }
+                } else if (isOrdering(command)) {
+                    emit("@R14");
+                    emit("M=D");
+                    emit("@SP");
+                    emit("AM=M-1");
+                    emit("D=M");
+                    emit("@R13");
+                    emit("M=D");
+                    compare();
+                    k += finishCompare(code, k, command, program);
+                } else {
+                    emit("@SP");
+                    emit("AM=M-1");
+                    switch (command) {
+                        case Command::ADD:
+                            emit("D=D+M");
+                            break;
+                        case Command::AND:
+                            emit("D=D&M");
+                            break;
+                        case Command::OR:
+                            emit("D=D|M");
+                            break;
+                        default:
+                            emit("D=M-D");
+                            break;
+                    }
+                    if (isCompare(command)) {
+                        k += finishCompare(code, k, command, program);
+                    }
+                }
+                break;
+            }
+            case Opcode::LABEL:
+                spill();
+                emitLabel(scoped(program.names[instruction.name]));
+                break;
+            case Opcode::GOTO:
+                spill();
+                emit("@" + scoped(program.names[instruction.name]));
+                emit("0;JMP");
+                break;
+            case Opcode::IF_GOTO:
+                load();
+                emit("@" + scoped(program.names[instruction.name]));
+                emit("D;JNE");
+                cached = false;
+                break;
+            case Opcode::CALL:
+                spill();
+                call(program.names[instruction.name], instruction.operand);
+                break;
+            case Opcode::FUNCTION:
+                spill();
+                function = program.names[instruction.name];
+                out.append("// function ").append(function).push_back('\n');
+                emitLabel(function);
+                cached = false;
+                if (instruction.operand > 0) {
+                    emit("@SP");
+                    emit("A=M");
+                    emit("M=0");
+                    for (uint32_t i = 1; i < instruction.operand; i++) {
+                        emit("A=A+1");
+                        emit("M=0");
+                    }
+                    emit("D=A+1");
+                    emit("@SP");
+                    emit("M=D");
+                }
+                break;
+            case Opcode::RETURN:
+                load();
+                emit("@$RETURN");
+                emit("0;JMP");
+                cached = false;
+                break;
+        }
+    }
+    spill();
+}
+
+string HackTranslator::finish() {
+    static const string_view SAVED[] = {"@LCL", "@ARG", "@THIS", "@THAT"};
+
+    // D = return address, R13 = callee: push the frame, ARG = SP - nArgs - 5, LCL = SP
+    for (uint32_t nArgs : callArities) {
+        emitLabel("$CALL." + to_string(nArgs));
+        for (size_t i = 0; i <= 4; i++) {
+            if (i > 0) {
+                emit(SAVED[i - 1]);
+                emit("D=M");
+            }
+            emit("@SP");
+            emit("AM=M+1");
+            emit("A=A-1");
+            emit("M=D");
+        }
+        emit("@SP");
+        emit("D=M");
+        emit("@LCL");
+        emit("M=D");
+        emit("@" + to_string(nArgs + 5));
+        emit("D=D-A");
+        emit("@ARG");
+        emit("M=D");
+        emit("@R13");
+        emit("A=M");
+        emit("0;JMP");
+    }
+
+    // D = return address, R13 = x, R14 = y: D = x - y when the signs are the same, else
+    // a value of x's sign (not 0), the subtraction alone would overflow
+    if (compares) {
+        emitLabel("$COMPARE");
+        emit("@R15");
+        emit("M=D");
+        emit("@R13");
+        emit("D=M");
+        emit("@$COMPARE.XNEG");
+        emit("D;JLT");
+        emit("@R14");
+        emit("D=M");
+        emit("@$COMPARE.SAME");
+        emit("D;JGE");
+        emit("D=1");
+        emit("@$COMPARE.END");
+        emit("0;JMP");
+        emitLabel("$COMPARE.XNEG");
+        emit("@R14");
+        emit("D=M");
+        emit("@$COMPARE.SAME");
+        emit("D;JLT");
+        emit("D=-1");
+        emit("@$COMPARE.END");
+        emit("0;JMP");
+        emitLabel("$COMPARE.SAME");
+        emit("@R13");
+        emit("D=M");
+        emit("@R14");
+        emit("D=D-M");
+        emitLabel("$COMPARE.END");
+        emit("@R15");
+        emit("A=M");
+        emit("0;JMP");
+    }
+
+    // D = return value, it stays in D for the caller and SP ends up at its slot (the old ARG)
+    emitLabel("$RETURN");
+    emit("@R13");
+    emit("M=D");
+    emit("@LCL");
+    emit("D=M");
+    emit("@5");
+    emit("A=D-A");
+    emit("D=M");
+    emit("@R14");
+    emit("M=D");
+    emit("@ARG");
+    emit("D=M");
+    emit("@SP");
+    emit("M=D");
+    for (auto restored : {"@THAT", "@THIS", "@ARG", "@LCL"}) {
+        emit("@LCL");
+        emit("AM=M-1");
+        emit("D=M");
+        emit(restored);
+        emit("M=D");
+    }
+    emit("@R13");
+    emit("D=M");
+    emit("@R14");
+    emit("A=M");
+    emit("0;JMP");
+
+    return move(out);
+}
@@ -1,55 +1,857 @@
 #include <JackAnalyzer/analyzer.hpp>
+#include <AsyncIO/io.hpp>
+#include <BuildCache/cache.hpp>
 #include <CompilationEngine/cengine.hpp>
+#include <CompileError/error.hpp>
+#include <CTranslator/translator.hpp>
+#include <FileWatcher/watcher.hpp>
+#include <HackTranslator/translator.hpp>
+#include <JackCompiler/compiler.hpp>
+#include <SymbolTable/table.hpp>
+#include <TimeReport/report.hpp>
+#include <VMInterpreter/interpreter.hpp>
+#include <VMProgram/program.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 
 using namespace std;
 namespace fs = filesystem;
 
 
-void JackAnalyzer::analyzeFile(const fs::path &file) {
+/* Begin Helper Function */
+
+static fs::path vmPathOf(const fs::path &file) {
     string filename = file.string();
     filename = filename.substr(0, filename.find_last_of('.'));
+    return fs::path(filename + (JackAnalyzer::vmFormat == VMFormat::BINARY ? ".vmb" : ".vm"));
+}
+
+// the exception currently being handled as "file:line: message" lines, one per error,
+// firstLine is where the compiled source starts in the file
+static string currentErrorReport(const fs::path &file, size_t firstLine = 1) {
+    string name = file.filename().string();
+    auto format = [&](const CompileError &error) {
+        return name + ":" + to_string(error.line() + firstLine - 1) + ": " + error.message() + "\n";
+    };
+
+    try {
+        throw;
+    } catch (CompileErrors &e) {
+        string report;
+        for (const auto &error : e.errors()) {
+            report += format(error);
+        }
+        return report;
+    } catch (CompileError &e) {
+        return format(e);
+    } catch (...) {
+        return name + ": " + currentErrorMessage() + "\n";
+    }
+}
+
+// a source that couldn't be read, error is its errno
+static string readErrorReport(const fs::path &file, int error) {
+    return file.filename().string() + ": cannot read: " + strerror(error) + "\n";
+}
+
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
 
-    fs::path outputxml = fs::path(filename + ".xml");
-    fs::path outputvm = fs::path(filename + ".vm");
+/* End Helper Function */
 
-    ifstream in (file);
-    ofstream outvm (outputvm);
 
-    ostream nullout(nullptr);
-    ostream &outxml = printXml ? cout : nullout;
+set<string> JackAnalyzer::analyzeFile(const string &source, string &outputvm, const ClassIndex &index, ostream &outxml) {
+    istringstream in (source);
+    ostringstream outvm;
 
-    CompilationEngine engine(in, outvm, outxml, table);
+    SymbolTable table;
+    CompilationEngine engine(in, outvm, outxml, table, index, parallelSubroutines ? &pool() : nullptr, vmFormat, instrument, profiled(),
+            pipelinedLexer);
     engine.compileClass();
+
+    outputvm = outvm.str();
+    if (PhaseTimes *times = TimeReport::current()) {
+        if (vmFormat == VMFormat::BINARY) {
+            istringstream code (outputvm);
+            VMProgram program;
+            while (VMProgram::readBinary(code, program)) {
+                times->instructions += program.code.size();
+                program.clear();
+            }
+        } else {
+            times->instructions += count(outputvm.begin(), outputvm.end(), '\n');
+        }
+    }
+    return engine.consumedClasses();
 }
 
-void JackAnalyzer::analyzeDir(const fs::path &dir) {
-    for (const auto &entry : fs::directory_iterator(dir)) {
-        // if file ends with .jack, compile it
-        if (boost::algorithm::ends_with(entry.path().string(), ".jack")) {
-            analyzeFile(entry.path());
+// a class with errors leaves no .vm behind, not even a stale one
+void JackAnalyzer::removeOutput(const fs::path &outputvm) {
+    io().defer([outputvm] {
+        error_code ec;
+        fs::remove(outputvm, ec);
+    });
+}
+
+bool JackAnalyzer::analyzeFiles(vector<fs::path> files, const fs::path &defaultCacheDir, const fs::path &program) {
+    // directory order is unspecified, sort so every run handles files the same way
+    sort(files.begin(), files.end());
+
+    // all sources are read in one batch, the compute threads only ever see them in memory
+    vector<string> sources;
+    vector<int> readErrors;
+    {
+        PhaseTimer timer (Phase::READ);
+        sources = io().readAll(files, readErrors);
+    }
+
+    // every class's signatures are known before any code is generated,
+    // incremental builds take them from the .vmi summaries of unchanged classes
+    ClassIndex index = ClassIndex::build(files, sources, pool(), useCache, keepResident);
+    for (const auto &name : profile.stale(index)) {
+        *diagnostics << "Warning: the profile of " << name << " doesn't match its code any more, it is ignored" << endl;
+    }
+    auto interfaceHashOf = [&index](const string &className) { return index.interfaceHash(className); };
+
+    // the output of every class is kept for linking, which happens once all of them compiled
+    vector<string> outputs(program.empty() ? 0 : files.size());
+
+    // restore classes whose source and consumed interfaces are unchanged, xml needs a real parse so it bypasses the cache
+    optional<BuildCache> cache;
+    vector<string> keys(files.size());
+    vector<char> hit(files.size(), false);
+    if ((useCache || keepResident) && !printXml) {
+        // resident processes without --cache only keep entries in memory
+        cache.emplace(!useCache ? fs::path() : cacheDir.empty() ? defaultCacheDir : cacheDir, keepResident);
+        string salt = VERSION + "\n" + optionsKey();
+        // instrumented Main.main dumps the counters of every class there is
+        for (const auto &className : instrument ? index.classNames() : vector<string>()) {
+            salt += " " + className;
         }
+        pool().parallelFor(files.size(), [&](size_t i) {
+            if (readErrors[i] != 0) return;
+
+            FileScope scope (files[i].string());
+            PhaseTimer timer (Phase::CACHE);
+            keys[i] = BuildCache::keyOf(sources[i], salt);
+            string vm;
+            hit[i] = cache->restore(keys[i], vm, interfaceHashOf);
+            if (hit[i]) {
+                if (!program.empty()) outputs[i] = vm;
+                io().write(vmPathOf(files[i]), move(vm));
+            }
+        });
     }
+
+    // xml and errors go to a buffer per file and are printed in file order afterwards,
+    // a broken file doesn't stop the others from being compiled and written,
+    // .vm files and cache entries are written behind the compile by the I/O thread
+    vector<ostringstream> xml(files.size());
+    vector<string> errors(files.size());
+
+    pool().parallelFor(files.size(), [&](size_t i) {
+        if (hit[i]) return;
+        if (readErrors[i] != 0) {
+            errors[i] = readErrorReport(files[i], readErrors[i]);
+            removeOutput(vmPathOf(files[i]));
+            return;
+        }
+
+        FileScope scope (files[i].string());
+        if (PhaseTimes *times = TimeReport::current()) {
+            times->bytes += sources[i].size();
+            times->lines += count(sources[i].begin(), sources[i].end(), '\n');
+        }
+        ostream nullout(nullptr);
+        try {
+            string vm;
+            set<string> consumed = analyzeFile(sources[i], vm, index, printXml ? xml[i] : nullout);
+            if (cache) {
+                BuildCache::Dependencies deps;
+                for (const auto &className : consumed) {
+                    deps.push_back({className, interfaceHashOf(className)});
+                }
+                io().defer([&cache, key = keys[i], vm, deps] { cache->store(key, vm, deps); });
+            }
+            if (!program.empty()) outputs[i] = vm;
+            io().write(vmPathOf(files[i]), move(vm));
+        } catch (...) {
+            errors[i] = currentErrorReport(files[i]);
+            removeOutput(vmPathOf(files[i]));
+        }
+    });
+    {
+        PhaseTimer timer (Phase::WRITE);
+        io().flush();
+    }
+
+    size_t nFailed = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        *console << xml[i].str();
+        *diagnostics << errors[i];
+        nFailed += !errors[i].empty();
+    }
+
+    if (nFailed > 0) {
+        *diagnostics << nFailed << " of " << files.size() << " files failed to compile." << endl;
+        return false;
+    }
+    return program.empty() || link(files, outputs, program);
+}
+
+bool JackAnalyzer::link(const vector<fs::path> &files, const vector<string> &outputs, const fs::path &program) {
+    PhaseTimer timer (Phase::LINK);
+    typedef struct unit_struct {
+        string fileName;
+        VMProgram code;
+    } Unit;
+
+    vector<Unit> units;
+    auto load = [&](const fs::path &file, const string &vm) {
+        istringstream in (vm);
+        Unit unit {file.stem().string(), VMProgram()};
+        bool ok = VMProgram::isBinary(vm) ? VMProgram::readBinary(in, unit.code) : VMProgram::readText(in, unit.code);
+        if (!ok) {
+            *diagnostics << file.filename().string() << ": not valid VM code" << endl;
+            return false;
+        }
+        units.push_back(move(unit));
+        return true;
+    };
+
+    set<string> compiled;
+    for (size_t i = 0; i < files.size(); i++) {
+        compiled.insert(files[i].stem().string());
+        if (!load(files[i], outputs[i])) return false;
+    }
+
+    // VM code without a Jack source, the OS classes usually, .vm wins over .vmb of the same class
+    map<string, fs::path> libraries;
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(program.parent_path(), ec)) {
+        string extension = entry.path().extension().string();
+        string stem = entry.path().stem().string();
+        if ((extension == ".vm" || extension == ".vmb") && !compiled.count(stem)
+                && (extension == ".vm" || !libraries.count(stem))) {
+            libraries[stem] = entry.path();
+        }
+    }
+
+    vector<fs::path> libraryFiles;
+    for (const auto &library : libraries) {
+        libraryFiles.push_back(library.second);
+    }
+    vector<int> readErrors;
+    vector<string> libraryCode = io().readAll(libraryFiles, readErrors);
+    for (size_t i = 0; i < libraryFiles.size(); i++) {
+        if (readErrors[i] != 0) {
+            *diagnostics << readErrorReport(libraryFiles[i], readErrors[i]);
+            return false;
+        }
+        if (!load(libraryFiles[i], libraryCode[i])) return false;
+    }
+
+    string name = program.filename().string();
+    if (emitAsm) {
+        HackTranslator translator;
+        bool hasSysInit = false;
+        for (const auto &unit : units) {
+            for (const auto &instruction : unit.code.code) {
+                hasSysInit |= instruction.opcode == Opcode::FUNCTION && unit.code.names[instruction.name] == "Sys.init";
+            }
+            translator.translate(unit.code, unit.fileName);
+        }
+
+        if (!hasSysInit) {
+            *diagnostics << "Warning: no Sys.init, add the OS .vm files next to the sources to run " << name << ".asm" << endl;
+        }
+        if (translator.size() > HackTranslator::ROM_SIZE) {
+            *diagnostics << "Warning: " << name << ".asm needs " << translator.size()
+                     << " instructions, more than the " << HackTranslator::ROM_SIZE << " the ROM holds" << endl;
+        }
+        // appended, not replaced: a folder like proj.v2 keeps its whole name
+        io().write(program.string() + ".asm", translator.finish());
+    }
+
+    if (emitC) {
+        CTranslator translator;
+        for (const auto &unit : units) {
+            translator.translate(unit.code, unit.fileName);
+        }
+        try {
+            io().write(program.string() + ".c", translator.finish());
+        } catch (runtime_error &e) {
+            *diagnostics << name << ".c: " << e.what() << endl;
+            return false;
+        }
+    }
+
+    io().flush();
+
+    if (runProgram) {
+        VMInterpreter interpreter (*console);
+        int status;
+        auto start = chrono::steady_clock::now();
+        try {
+            for (const auto &unit : units) {
+                interpreter.load(unit.code, unit.fileName);
+            }
+            status = interpreter.run();
+        } catch (runtime_error &e) {
+            *diagnostics << name << ": " << e.what() << endl;
+            return false;
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        *diagnostics << name << ": " << interpreter.executed() << " VM instructions in " << fixed << setprecision(3) << seconds << " s ("
+             << setprecision(0) << interpreter.executed() / max(seconds, 1e-9) / 1e6 << "M/s), exit status " << status << endl;
+        return status == 0;
+    }
+    return true;
+}
+
+ThreadPool &JackAnalyzer::pool() {
+    static ThreadPool shared;
+    return shared;
+}
+
+AsyncIO &JackAnalyzer::io() {
+    static AsyncIO shared;
+    return shared;
+}
+
+string JackAnalyzer::optionsKey() {
+    string key = vmFormat == VMFormat::BINARY ? "binary" : "";
+    if (instrument) key += key.empty() ? "instrument" : " instrument";
+    if (!profile.empty()) key += (key.empty() ? "profile=" : " profile=") + to_string(profile.digest());
+    return key;
 }
 
 bool JackAnalyzer::analyze(string arg) {
+    auto reported = [](bool ok) {
+        if (TimeReport::active()) TimeReport::print(*console);
+        return ok;
+    };
+
     // check if argument is a directory
     fs::path dir = fs::path(arg);
     auto dirStatus = fs::status(dir);
     if (dirStatus.type() == fs::file_type::directory) {
-        analyzeDir(dir);
-        return true;
+        vector<fs::path> files;
+        for (const auto &entry : fs::directory_iterator(dir)) {
+            // if file ends with .jack, compile it
+            if (boost::algorithm::ends_with(entry.path().string(), ".jack")) {
+                files.push_back(entry.path());
+            }
+        }
+
+        fs::path program = fs::absolute(dir).lexically_normal();
+        if (program.filename().empty()) program = program.parent_path();
+        return reported(analyzeFiles(files, dir / ".jackc-cache", emitAsm || emitC || runProgram ? program / program.filename() : fs::path()));
     }
 
     // check if argument is a .jack file
     fs::path jackFile = fs::path(arg + ".jack");
     if (fs::exists(jackFile)) {
-        analyzeFile(jackFile);
-        return true;
+        fs::path program = fs::absolute(jackFile).replace_extension();
+        return reported(analyzeFiles({jackFile}, jackFile.parent_path() / ".jackc-cache", emitAsm || emitC || runProgram ? program : fs::path()));
     }
 
-    cout << "File not found." << endl;
+    *diagnostics << "File not found." << endl;
     return false;
 }
+
+void JackAnalyzer::compileSource(const string &source, ostream &outvm) {
+    CompileOptions options;
+    options.xml = printXml;
+    options.pool = &pool();
+    options.parallelSubroutines = parallelSubroutines;
+    options.format = vmFormat;
+    options.instrument = instrument;
+    options.profile = profiled();
+
+    CompileResult result = JackCompiler::compile(Source {"<source>", source}, options);
+    if (printXml) {
+        *console << result.xml[0];
+    }
+    if (!result.ok) {
+        vector<CompileError> errors;
+        for (const auto &diagnostic : result.diagnostics) {
+            errors.push_back(CompileError(diagnostic.message, diagnostic.line));
+        }
+        throw CompileErrors(errors);
+    }
+
+    outvm << result.vm[0];
+}
+
+bool JackAnalyzer::compileStream(istream &in, ostream &out) {
+    // classes seen so far, later classes are unknown when an earlier one is compiled
+    ClassIndex index;
+    bool ok = true;
+    size_t firstLine = 1;
+
+    // the code of a class goes out subroutine by subroutine while it has no errors,
+    // the rest of a broken class is held back and only its errors are reported
+    auto compileClass = [&](const string &source) {
+        size_t startLine = firstLine;
+        firstLine += count(source.begin(), source.end(), '\n');
+        if (source.find_first_not_of(" \t\r\n") == string::npos) {
+            return;
+        }
+
+        index.update(source);
+        istringstream classIn (source);
+        ostringstream classOut;
+        ostream nullout(nullptr);
+
+        // xml would get mixed into the vm code, it goes to stderr instead
+        SymbolTable table;
+        CompilationEngine engine(classIn, classOut, printXml ? cerr : nullout, table, index, parallelSubroutines ? &pool() : nullptr, vmFormat, instrument, profiled(),
+            pipelinedLexer);
+        engine.onSubroutineDone([&] {
+            out << classOut.str();
+            out.flush();
+            classOut.str("");
+        });
+        try {
+            engine.compileClass();
+            out << classOut.str();
+        } catch (...) {
+            cerr << currentErrorReport("<stdin>", startLine);
+            ok = false;
+        }
+        out.flush();
+    };
+
+    // split the stream into classes by following the braces outside of comments and strings
+    enum class State { CODE, LINE_COMMENT, BLOCK_COMMENT, STRING };
+    State state = State::CODE;
+    size_t depth = 0;
+    string current;
+    string line;
+    while (getline(in, line)) {
+        line.push_back('\n');
+        for (size_t i = 0; i < line.size(); i++) {
+            char c = line[i];
+            char next = i + 1 < line.size() ? line[i + 1] : '\0';
+            current.push_back(c);
+
+            switch (state) {
+                case State::LINE_COMMENT:
+                    if (c == '\n') state = State::CODE;
+                    break;
+                case State::BLOCK_COMMENT:
+                    if (c == '*' && next == '/') {
+                        current.push_back(next);
+                        i++;
+                        state = State::CODE;
+                    }
+                    break;
+                case State::STRING:
+                    if (c == '"' || c == '\n') state = State::CODE;
+                    break;
+                case State::CODE:
+                    if (c == '/' && (next == '/' || next == '*')) {
+                        current.push_back(next);
+                        i++;
+                        state = next == '/' ? State::LINE_COMMENT : State::BLOCK_COMMENT;
+                    } else if (c == '"') {
+                        state = State::STRING;
+                    } else if (c == '{') {
+                        depth++;
+                    } else if (c == '}' && depth > 0 && --depth == 0) {
+                        compileClass(current);
+                        current.clear();
+                    }
+                    break;
+            }
+        }
+    }
+
+    // whatever is left is an unterminated class, let the compiler report it
+    compileClass(current);
+    return ok;
+}
+
+int JackAnalyzer::watch(string arg) {
+    fs::path dir = fs::path(arg);
+    if (!fs::is_directory(dir)) {
+        *diagnostics << "--watch needs a directory." << endl;
+        return 1;
+    }
+
+    FileWatcher watcher(dir);
+    if (!watcher.ok()) {
+        *diagnostics << "Cannot watch " << arg << endl;
+        return 1;
+    }
+
+    // per file state kept resident between edits
+    map<fs::path, string> sources;
+    map<fs::path, string> classNames;               /* class declared by each file */
+    map<fs::path, set<string>> consumed;            /* classes whose interface each file used */
+    set<fs::path> failed;                           /* retried on every rebuild, their dependencies are unknown */
+    map<fs::path, int> unreadable;                  /* errno of the files that can't be read, indexed as empty */
+    ClassIndex index;
+
+    auto compile = [&](const vector<fs::path> &files) {
+        vector<set<string>> used(files.size());
+        vector<string> errors(files.size());
+        // the workers share the maps, they only look things up in them
+        pool().parallelFor(files.size(), [&](size_t i) {
+            if (unreadable.count(files[i])) {
+                errors[i] = readErrorReport(files[i], unreadable.at(files[i]));
+                removeOutput(vmPathOf(files[i]));
+                return;
+            }
+
+            ostream nullout(nullptr);
+            try {
+                string vm;
+                used[i] = analyzeFile(sources.at(files[i]), vm, index, nullout);
+                io().write(vmPathOf(files[i]), move(vm));
+            } catch (...) {
+                errors[i] = currentErrorReport(files[i]);
+                removeOutput(vmPathOf(files[i]));
+            }
+        });
+        io().flush();
+
+        for (size_t i = 0; i < files.size(); i++) {
+            consumed[files[i]] = used[i];
+            failed.erase(files[i]);
+            if (!errors[i].empty()) {
+                failed.insert(files[i]);
+                *diagnostics << errors[i];
+            }
+        }
+    };
+
+    auto listSources = [&dir] {
+        vector<fs::path> files;
+        error_code ec;
+        for (const auto &entry : fs::directory_iterator(dir, ec)) {
+            if (boost::algorithm::ends_with(entry.path().string(), ".jack")) {
+                files.push_back(entry.path());
+            }
+        }
+        sort(files.begin(), files.end());
+        return files;
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<fs::path> files = listSources();
+
+    vector<int> readErrors;
+    vector<string> contents = io().readAll(files, readErrors);
+    for (size_t i = 0; i < files.size(); i++) {
+        if (readErrors[i] != 0) unreadable[files[i]] = readErrors[i];
+        sources[files[i]] = move(contents[i]);
+        classNames[files[i]] = index.update(sources[files[i]]);
+    }
+    compile(files);
+    *console << "Compiled " << files.size() << " files in " << fixed << setprecision(2)
+             << millisecondsSince(start) << " ms, watching " << arg << endl;
+
+    while (true) {
+        vector<fs::path> changed = watcher.wait();
+        bool rescan = watcher.overflowed();
+        if (changed.empty() && !rescan) {
+            *diagnostics << "Lost the watch on " << arg << endl;
+            return 1;
+        }
+        start = chrono::steady_clock::now();
+
+        // events were dropped: every file that is or was there is looked at again and everything is recompiled
+        if (rescan) {
+            changed = listSources();
+            for (const auto &entry : sources) {
+                changed.push_back(entry.first);
+            }
+            sort(changed.begin(), changed.end());
+            changed.erase(unique(changed.begin(), changed.end()), changed.end());
+        }
+
+        vector<fs::path> present;
+        for (const auto &file : changed) {
+            if (fs::exists(file)) present.push_back(file);
+        }
+        vector<string> contents = io().readAll(present, readErrors);
+
+        set<string> changedInterfaces;
+        vector<fs::path> edited;
+        for (const auto &file : changed) {
+            string oldClass = classNames.count(file) ? classNames[file] : "";
+            uint64_t oldInterface = index.interfaceHash(oldClass);
+
+            auto readIndex = find(present.begin(), present.end(), file);
+            if (readIndex == present.end()) {
+                if (!oldClass.empty()) {
+                    index.remove(oldClass);
+                    changedInterfaces.insert(oldClass);
+                }
+                // a stale .vm would still be linked into the program
+                removeOutput(vmPathOf(file));
+                sources.erase(file);
+                classNames.erase(file);
+                consumed.erase(file);
+                failed.erase(file);
+                unreadable.erase(file);
+                continue;
+            }
+
+            // a file that can't be read is compiled again to report it, until it can be
+            size_t k = readIndex - present.begin();
+            string source = move(contents[k]);
+            bool wasUnreadable = unreadable.erase(file) > 0;
+            if (readErrors[k] != 0) {
+                unreadable[file] = readErrors[k];
+            } else if (!wasUnreadable && sources.count(file) && sources[file] == source) {
+                continue;
+            }
+
+            if (!oldClass.empty()) {
+                index.remove(oldClass);
+            }
+            sources[file] = source;
+            classNames[file] = index.update(source);
+
+            if (classNames[file] != oldClass) {
+                changedInterfaces.insert(oldClass);
+            }
+            if (index.interfaceHash(classNames[file]) != oldInterface) {
+                changedInterfaces.insert(classNames[file]);
+            }
+            edited.push_back(file);
+        }
+
+        // files that used an interface which just changed are compiled again as well
+        vector<fs::path> dirty = edited;
+        for (const auto &[file, used] : consumed) {
+            if (find(edited.begin(), edited.end(), file) != edited.end()) continue;
+            if (rescan) {
+                dirty.push_back(file);
+                continue;
+            }
+            if (failed.count(file)) {
+                dirty.push_back(file);
+                continue;
+            }
+            for (const auto &className : used) {
+                if (changedInterfaces.count(className)) {
+                    dirty.push_back(file);
+                    break;
+                }
+            }
+        }
+
+        if (dirty.empty()) {
+            io().flush();
+            continue;
+        }
+
+        compile(dirty);
+
+        // edit to .vm: from the moment the editor wrote the file until its .vm is written
+        double latency = 0;
+        for (const auto &file : edited) {
+            error_code ec;
+            auto written = fs::last_write_time(file, ec);
+            if (!ec) {
+                latency = max(latency, chrono::duration<double, milli>(fs::file_time_type::clock::now() - written).count());
+            }
+        }
+
+        if (rescan) {
+            *console << "Events were lost, rescanned " << arg << ". ";
+        }
+        *console << "Recompiled " << edited.size() << " edited";
+        if (dirty.size() > edited.size()) {
+            *console << " and " << dirty.size() - edited.size() << " dependent";
+        }
+        *console << " files in " << fixed << setprecision(2) << millisecondsSince(start) << " ms"
+                 << " (edit to .vm " << latency << " ms)" << endl;
+    }
+}
+
+int JackAnalyzer::dump(string file) {
+    ifstream in(file, ios::binary);
+    if (!in) {
+        *diagnostics << "File not found." << endl;
+        return 1;
+    }
+
+    // one program per class, stdin mode writes them back to back
+    VMProgram program;
+    do {
+        if (!VMProgram::readBinary(in, program)) {
+            *diagnostics << file << ": not a valid .vmb file" << endl;
+            return 1;
+        }
+        program.writeText(*console);
+    } while (in.peek() != EOF);
+
+    return 0;
+}
+
+int JackAnalyzer::batch(string manifest) {
+    typedef struct project_struct {
+        string line;                                /* as written in the manifest, used in the summary */
+        fs::path outputDir;                         /* empty: next to each source */
+        vector<fs::path> files;
+        vector<string> sources;
+        string error;
+        size_t nFailed = 0;
+    } Project;
+
+    ifstream in (manifest);
+    if (!in) {
+        *diagnostics << "Cannot open manifest " << manifest << endl;
+        return 1;
+    }
+
+    fs::path base = fs::path(manifest).parent_path();
+    vector<Project> projects;
+    string line;
+    while (getline(in, line)) {
+        boost::algorithm::trim(line);
+        if (line.empty() || line[0] == '#') continue;
+
+        Project project;
+        project.line = line;
+
+        size_t colon = line.find(':');
+        if (colon == string::npos) {
+            fs::path dir = base / line;
+            error_code ec;
+            for (const auto &entry : fs::directory_iterator(dir, ec)) {
+                if (boost::algorithm::ends_with(entry.path().string(), ".jack")) {
+                    project.files.push_back(entry.path());
+                }
+            }
+            if (ec) {
+                project.error = "cannot read directory";
+            }
+        } else {
+            project.outputDir = base / boost::algorithm::trim_copy(line.substr(0, colon));
+            istringstream names (line.substr(colon + 1));
+            string name;
+            while (names >> name) {
+                project.files.push_back(base / name);
+            }
+        }
+
+        sort(project.files.begin(), project.files.end());
+
+        // the outputs of a listed project all go to one directory, by file name
+        set<fs::path> outputs;
+        for (const auto &file : project.files) {
+            if (!project.outputDir.empty() && !outputs.insert(file.filename()).second) {
+                project.error = "more than one source named " + file.filename().string();
+            }
+        }
+        projects.push_back(move(project));
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    // the sources of every project are read in one batch before any compiling starts
+    vector<fs::path> allFiles;
+    for (auto &project : projects) {
+        for (const auto &file : project.files) {
+            if (!fs::exists(file)) {
+                project.error = file.string() + ": file not found";
+                break;
+            }
+        }
+        if (project.error.empty()) {
+            allFiles.insert(allFiles.end(), project.files.begin(), project.files.end());
+        }
+    }
+    vector<int> readErrors;
+    vector<string> allSources = io().readAll(allFiles, readErrors);
+    size_t next = 0;
+    for (auto &project : projects) {
+        if (!project.error.empty()) continue;
+        for (size_t i = 0; i < project.files.size(); i++, next++) {
+            if (readErrors[next] != 0 && project.error.empty()) {
+                project.error = project.files[i].string() + ": cannot read: " + strerror(readErrors[next]);
+            }
+            project.sources.push_back(move(allSources[next]));
+        }
+    }
+
+    // projects run side by side on the shared pool, their files are spread over it as well
+    pool().parallelFor(projects.size(), [&](size_t p) {
+        Project &project = projects[p];
+        if (!project.error.empty()) return;
+
+        vector<Source> sources(project.files.size());
+        for (size_t i = 0; i < project.files.size(); i++) {
+            // named by path, sources from different directories may share a file name
+            sources[i] = Source {project.files[i].string(), move(project.sources[i])};
+        }
+
+        CompileOptions options;
+        options.pool = &pool();
+        options.parallelSubroutines = parallelSubroutines;
+        options.format = vmFormat;
+        options.instrument = instrument;
+        options.profile = profiled();
+        options.pipelinedLexer = pipelinedLexer;
+        CompileResult result = JackCompiler::compile(sources, options);
+
+        set<string> failed;
+        for (const auto &diagnostic : result.diagnostics) {
+            failed.insert(diagnostic.file);
+        }
+        project.nFailed = failed.size();
+        if (!result.ok) {
+            const Diagnostic &first = result.diagnostics[0];
+            project.error = first.file + (first.line > 0 ? ":" + to_string(first.line) : "") + ": " + first.message;
+        }
+
+        if (!project.outputDir.empty()) {
+            error_code ec;
+            fs::create_directories(project.outputDir, ec);
+        }
+        for (size_t i = 0; i < project.files.size(); i++) {
+            fs::path output = project.outputDir.empty() ? vmPathOf(project.files[i])
+                    : project.outputDir / vmPathOf(project.files[i]).filename();
+            if (failed.count(sources[i].name)) {
+                removeOutput(output);
+                continue;
+            }
+            io().write(output, move(result.vm[i]));
+        }
+    });
+    io().flush();
+
+    size_t nFailed = 0;
+    for (const auto &project : projects) {
+        if (project.error.empty()) {
+            *console << "OK    " << project.line << " (" << project.files.size() << " classes)" << endl;
+        } else {
+            nFailed++;
+            *console << "FAIL  " << project.line << " (";
+            if (project.nFailed > 0) {
+                *console << project.nFailed << " of " << project.files.size() << " classes failed, first: ";
+            }
+            *console << project.error << ")" << endl;
+        }
+    }
+    *console << projects.size() - nFailed << " of " << projects.size() << " projects compiled in "
+             << fixed << setprecision(2) << millisecondsSince(start) << " ms" << endl;
+
+    return nFailed == 0 ? 0 : 1;
+}
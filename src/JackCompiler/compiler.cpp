@@ -0,0 +1,80 @@
+#include <JackCompiler/compiler.hpp>
+#include <ClassIndex/index.hpp>
+#include <CompileError/error.hpp>
+#include <CompilationEngine/cengine.hpp>
+#include <SymbolTable/table.hpp>
+#include <sstream>
+
+using namespace std;
+
+
+CompileResult JackCompiler::compile(const vector<Source> &sources, const CompileOptions &options) {
+    CompileResult result;
+    result.vm.resize(sources.size());
+    if (options.xml) {
+        result.xml.resize(sources.size());
+    }
+
+    // the pre-pass only needs the code, there are no files behind the sources
+    vector<fs::path> noFiles(sources.size());
+    vector<string> code(sources.size());
+    for (size_t i = 0; i < sources.size(); i++) {
+        code[i] = sources[i].code;
+    }
+
+    ThreadPool *pool = options.pool;
+    ClassIndex index;
+    vector<vector<Diagnostic>> errors(sources.size());
+
+    auto compileOne = [&](size_t i) {
+        istringstream in (sources[i].code);
+        ostringstream vm, xml;
+        ostream nullout(nullptr);
+
+        try {
+            SymbolTable table;
+            CompilationEngine engine(in, vm, options.xml ? xml : nullout, table, index,
+                    options.parallelSubroutines ? options.pool : nullptr, options.format, options.instrument, options.profile,
+                    options.pipelinedLexer);
+            engine.compileClass();
+        } catch (CompileErrors &e) {
+            for (const auto &error : e.errors()) {
+                errors[i].push_back(Diagnostic {sources[i].name, error.line(), error.message()});
+            }
+        } catch (CompileError &e) {
+            errors[i].push_back(Diagnostic {sources[i].name, e.line(), e.message()});
+        } catch (...) {
+            errors[i].push_back(Diagnostic {sources[i].name, 0, currentErrorMessage()});
+        }
+
+        result.vm[i] = vm.str();
+        if (options.xml) {
+            result.xml[i] = xml.str();
+        }
+    };
+
+    if (pool != nullptr) {
+        index = ClassIndex::build(noFiles, code, *pool);
+        pool->parallelFor(sources.size(), compileOne);
+    } else {
+        for (size_t i = 0; i < sources.size(); i++) {
+            index.update(code[i]);
+        }
+        for (size_t i = 0; i < sources.size(); i++) {
+            compileOne(i);
+        }
+    }
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (!errors[i].empty()) {
+            result.ok = false;
+            result.diagnostics.insert(result.diagnostics.end(), errors[i].begin(), errors[i].end());
+        }
+    }
+
+    return result;
+}
+
+CompileResult JackCompiler::compile(const Source &source, const CompileOptions &options) {
+    return compile(vector<Source> {source}, options);
+}
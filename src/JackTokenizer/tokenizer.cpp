@@ -1,8 +1,11 @@
 #include <JackTokenizer/tokenizer.hpp>
+#include <TimeReport/report.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/bimap.hpp>
 #include <boost/assign.hpp>
+#include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include <regex>
 
@@ -42,101 +45,177 @@ const boost::bimap<string, Keyword> Tokenizer::KEYWORDMAPPING = boost::assign::l
     ("while", Keyword::WHILE)
     ("return", Keyword::RETURN);
 
-// side effects: token will be emptied
-void Tokenizer::addToTokens(string &token) {
-    if (token.size() > 0) {
-        tokens.push_back(token);
-    }
+const size_t Tokenizer::PIPELINE_MIN_SIZE = 64 * 1024;
 
-    token = "";
-}
 
-// no side effects
-void Tokenizer::addToTokens(char c) {
-    tokens.push_back(string {c});
-}
+/* Begin Helper Function */
 
-void Tokenizer::splitIntoTokens(string &code) {
+struct LexerCancelled {};
+
+// calls emit(begin, size, line) for every token of code, dropping comments
+template <typename Emit>
+static void scan(const string &code, Emit emit) {
     size_t pos;
-    string token = "";
+    size_t line = 1;
+    size_t wordBegin = 0;
+    size_t wordSize = 0;
+
+    auto endWord = [&]() {
+        if (wordSize > 0) {
+            emit(wordBegin, wordSize, line);
+        }
+        wordSize = 0;
+    };
 
     for (pos = 0; pos < code.size(); pos++) {
         char c = code[pos];
+        char next = pos + 1 < code.size() ? code[pos + 1] : '\0';
 
+        // found comment, skip it but keep counting lines
+        if (c == '/' && next == '/') {
+            endWord();
+            while (pos + 1 < code.size() && code[pos + 1] != '\n') pos++;
+        }
+        else if (c == '/' && next == '*') {
+            endWord();
+            size_t startLine = line;
+            pos += 2;
+            while (pos + 1 < code.size() && !(code[pos] == '*' && code[pos + 1] == '/')) {
+                if (code[pos] == '\n') line++;
+                pos++;
+            }
+            if (pos + 1 >= code.size()) {
+                throw CompileError("Error: non-terminated comment", startLine);
+            }
+            pos++;
+        }
         // found symbol
-        if (SYMBOLLIST.find(c) != string::npos) {
-            addToTokens(token);
-            addToTokens(c);
+        else if (Tokenizer::SYMBOLLIST.find(c) != string::npos) {
+            endWord();
+            emit(pos, 1, line);
         }
         // found whitespace
         else if (isspace(c)) {
-            addToTokens(token);
+            endWord();
+            if (c == '\n') line++;
         }
-        // special case for stringConstant
+        // special case for stringConstant, the token keeps its quotes
         else if (c == '"') {
-            token = "";
-            token.push_back('"');
-            char s;
-            try {
-                while ((s = code[++pos]) != '"') {
-                    token += s;
-                }
-            } catch(exception &e) {
-                cout << "Error: non-terminated string \"" << endl;
-                throw e;
+            endWord();
+            size_t begin = pos;
+            while (++pos < code.size() && code[pos] != '"' && code[pos] != '\n');
+            if (pos >= code.size() || code[pos] != '"') {
+                throw CompileError("Error: non-terminated string \"", line);
             }
-
-            token.push_back('"');
-            addToTokens(token);
+            emit(begin, pos - begin + 1, line);
         }
         else {
-            token.push_back(c);
+            if (wordSize == 0) wordBegin = pos;
+            wordSize++;
         }
     }
 
-    // if token is not empty, add to tokens
-    addToTokens(token);
+    // if a word is pending, add it to tokens
+    endWord();
 }
 
-Tokenizer::Tokenizer(istream &input) {
-    string fullCode = "";
-    string line;
-    regex multilineComments ( R"(\/\*.*?\*\/)" );
-    regex inlineComment ( R"(\/\/.*)" );
+/* End Helper Function */
 
-    while (getline(input, line)) {
-        // strip line
-        boost::algorithm::trim(line);
 
-         // ignore line that is whitespace or comment
-        if (line.empty() || line.rfind("//", 0) == 0 || line.find_first_not_of(" ") == string::npos) {
-            continue;
-        }
+/* Begin Private Methods */
+
+bool Tokenizer::fetch(size_t index) {
+    TokenRecord record;
+    while (index >= tokens.size() && pipeline && pipeline->queue.pop(record)) {
+        tokens.push_back(pipeline->code.substr(record.begin, record.size));
+        lines.push_back(record.line);
+    }
+    return index < tokens.size();
+}
 
-        // remove inline comment
-        line = regex_replace(line, inlineComment, "");
+/* End Private Methods */
 
-        fullCode += line;
+
+Tokenizer::Tokenizer(istream &input, bool pipelined) {
+    PhaseTimer timer (Phase::LEX);
+    string code (istreambuf_iterator<char>(input), {});
+
+    // lexing in parallel needs a second core to run on
+    if (!pipelined || code.size() < PIPELINE_MIN_SIZE || thread::hardware_concurrency() < 2) {
+        // split the code into tokens, dropping comments
+        scan(code, [&](size_t begin, size_t size, size_t line) {
+            tokens.push_back(code.substr(begin, size));
+            lines.push_back(line);
+        });
+        return;
     }
 
-    // remove multiline comments
-    fullCode = regex_replace(fullCode, multilineComments, "");
+    pipeline = make_unique<Pipeline>();
+    pipeline->code = move(code);
+    Pipeline *state = pipeline.get();
+    state->lexer = thread([state] {
+        try {
+            scan(state->code, [&](size_t begin, size_t size, size_t line) {
+                if (!state->queue.push(TokenRecord {begin, size, line})) {
+                    throw LexerCancelled();
+                }
+            });
+        } catch (CompileError &e) {
+            state->error = e;
+        } catch (LexerCancelled &) {
+            // the parser is gone, nobody needs the rest
+        }
+        state->queue.close();
+    });
+}
 
-    
-    // split the code into tokens
-    splitIntoTokens(fullCode);
+Tokenizer::~Tokenizer() {
+    if (pipeline && pipeline->lexer.joinable()) {
+        pipeline->queue.cancel();
+        pipeline->lexer.join();
+    }
+}
+
+void Tokenizer::finish() {
+    if (!pipeline) return;
+
+    while (fetch(tokens.size()));
+    if (pipeline->lexer.joinable()) {
+        pipeline->lexer.join();
+    }
+    if (pipeline->error) {
+        throw *pipeline->error;
+    }
+}
+
+Tokenizer Tokenizer::slice(size_t begin, size_t end) const {
+    Tokenizer part;
+    part.tokens.assign(tokens.begin() + begin, tokens.begin() + end);
+    part.lines.assign(lines.begin() + begin, lines.begin() + end);
+    return part;
 }
 
 bool Tokenizer::hasMoreTokens() {
-    return (tokenCounter < (tokens.size() - 1));
+    return fetch(tokenCounter + 1);
 }
 
+// advancing past the last token reaches the end of the input
 void Tokenizer::advance() {
-    if (hasMoreTokens()) {
+    if (fetch(tokenCounter)) {
         tokenCounter++;
     }
 }
 
+bool Tokenizer::atEnd() {
+    return !fetch(tokenCounter);
+}
+
+size_t Tokenizer::line() {
+    fetch(tokenCounter);
+    if (tokens.empty()) return 1;
+    return lines[min(tokenCounter, tokens.size() - 1)];
+}
+
 void Tokenizer::backtrack() {
     if (tokenCounter > 0) {
         tokenCounter--;
@@ -144,12 +223,12 @@ void Tokenizer::backtrack() {
 }
 
 Token Tokenizer::tokenType() {
-    string token = tokens[tokenCounter];
-
-    if (token.empty()) {
-        throw "Error: Empty token";
+    if (atEnd()) {
+        throw CompileError("Error: Unexpected end of file", line());
     }
 
+    const string &token = tokens[tokenCounter];
+
     // check if token is a keyword
     if (find(KEYWORDLIST.begin(), KEYWORDLIST.end(), token) != KEYWORDLIST.end()) {
         return Token::KEYWORD;
@@ -171,17 +250,20 @@ Token Tokenizer::tokenType() {
     else if (regex_search(token, IDENTIFIERREGEX)) {
         return Token::IDENTIFIER;
     } else {
-        string err = "Error: Invalid Constant " + token;
-        throw err;
+        throw CompileError("Error: Invalid Constant " + token, line());
     }
 }
 
 Keyword Tokenizer::keyWord() {
-    string token = tokens[tokenCounter];
+    if (atEnd()) {
+        throw CompileError("Error: Unexpected end of file", line());
+    }
+
+    const string &token = tokens[tokenCounter];
     auto result = Tokenizer::KEYWORDMAPPING.left.find(token);
     if (result == Tokenizer::KEYWORDMAPPING.left.end()) {
         // if not found, throw an error
-        throw "Error: Invalid keyword " + token;
+        throw CompileError("Error: Invalid keyword " + token, line());
     } else {
         return result->second;
     }
@@ -189,7 +271,7 @@ Keyword Tokenizer::keyWord() {
 
 char Tokenizer::symbol() {
     if (tokenType() != Token::SYMBOL) {
-        throw "Error: can't get symbol from non-symbol";
+        throw CompileError("Error: can't get symbol from non-symbol", line());
     }
 
     return tokens[tokenCounter][0];
@@ -197,7 +279,7 @@ char Tokenizer::symbol() {
 
 string Tokenizer::identifier() {
     if (tokenType() != Token::IDENTIFIER) {
-        throw "Error: can't get identifier from non-identifier";
+        throw CompileError("Error: can't get identifier from non-identifier", line());
     }
 
     return tokens[tokenCounter];
@@ -205,15 +287,21 @@ string Tokenizer::identifier() {
 
 int Tokenizer::intVal() {
     if (tokenType() != Token::INT_CONST) {
-        throw "Error: can't get integer constant from non-integer";
+        throw CompileError("Error: can't get integer constant from non-integer", line());
+    }
+
+    // jack integer constants are 0 .. 32767
+    const string &token = tokens[tokenCounter];
+    if (token.size() > 5 || stoi(token) > 32767) {
+        throw CompileError("Error: integer constant " + token + " out of range", line());
     }
 
-    return stoi(tokens[tokenCounter]);
+    return stoi(token);
 }
 
 string Tokenizer::stringVal() {
     if (tokenType() != Token::STRING_CONST) {
-        throw "Error: can't get string constant from non-string constant";
+        throw CompileError("Error: can't get string constant from non-string constant", line());
     }
 
     string token = tokens[tokenCounter];
@@ -0,0 +1,74 @@
+#include <Profile/profile.hpp>
+#include <BuildCache/cache.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+
+
+bool Profile::read(const fs::path &file, Profile &profile) {
+    ifstream in (file);
+    if (!in) return false;
+    profile.parse(in);
+    return !in.bad();
+}
+
+void Profile::parse(istream &in) {
+    string line;
+    while (getline(in, line)) {
+        istringstream fields (line);
+        string record;
+        string name;
+        if (!(fields >> record >> name)) continue;
+
+        size_t n;
+        uint64_t count;
+        string rest;
+        if (record == "hash") {
+            uint64_t hash;
+            if (!(fields >> hex >> hash) || fields >> rest) continue;
+            SubroutineProfile &subroutine = subroutines[name];
+            subroutine.conflicting |= subroutine.hashed && subroutine.bodyHash != hash;
+            subroutine.bodyHash = hash;
+            subroutine.hashed = true;
+        } else if (record == "function") {
+            if (!(fields >> count) || fields >> rest) continue;
+            subroutines[name].calls += count;
+        } else if (record == "loop" || record == "then" || record == "else") {
+            if (!(fields >> n >> count) || fields >> rest) continue;
+            SubroutineProfile &subroutine = subroutines[name];
+            if (record == "loop") {
+                subroutine.loops[n] += count;
+            } else {
+                (record == "then" ? subroutine.branches[n].first : subroutine.branches[n].second) += count;
+            }
+        } else {
+            continue;
+        }
+        contentHash = BuildCache::hash(line + "\n", contentHash);
+    }
+}
+
+const SubroutineProfile *Profile::find(const string &name, uint64_t bodyHash) const {
+    auto subroutine = subroutines.find(name);
+    if (subroutine == subroutines.end() || !subroutine->second.hashed || subroutine->second.conflicting
+            || subroutine->second.bodyHash != bodyHash) {
+        return nullptr;
+    }
+    return &subroutine->second;
+}
+
+vector<string> Profile::stale(const ClassIndex &index) const {
+    vector<string> names;
+    for (const auto &entry : subroutines) {
+        size_t dot = entry.first.find('.');
+        if (dot == string::npos) continue;
+        const Subroutine *subroutine = index.find(entry.first.substr(0, dot), entry.first.substr(dot + 1));
+        if (index.hasClass(entry.first.substr(0, dot)) && (!subroutine || !find(entry.first, subroutine->bodyHash))) {
+            names.push_back(entry.first);
+        }
+    }
+    sort(names.begin(), names.end());
+    return names;
+}
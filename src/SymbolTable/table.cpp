@@ -1,103 +1,155 @@
 #include <SymbolTable/table.hpp>
 #include <SymbolTable/var.hpp>
+#include <TimeReport/report.hpp>
 #include <stdexcept>
 #include <iostream>
 
 using namespace std;
 
 
+/* Begin Helper Function */
+
+static Segment segmentOf(Kind kind) {
+    static const Segment SEGMENTS[] = {Segment::STATIC, Segment::THIS, Segment::ARG, Segment::LOCAL};    /* by Kind */
+    return SEGMENTS[size_t(kind)];
+}
+
+/* End Helper Function */
+
+
 SymbolTable::SymbolTable() {
 }
 
-Var *SymbolTable::find(string name) {
-    auto resultSubroutine = subroutineTable.find(name);
-    if (resultSubroutine != subroutineTable.end()) {
-        return &resultSubroutine->second;
+SymbolTable::SymbolTable(const SymbolTable &other) {
+    for (size_t i = 0; i < 4; i++) {
+        counts[i] = other.counts[i];
+    }
+    for (const Scope *scope : {&other.staticTable, &other.fieldTable, &other.subroutineTable}) {
+        for (const auto &entry : *scope) {
+            Var var = entry.second;
+            var.type = *typeNames.insert(string(var.type)).first;
+            scopeOf(var.kind).insert(entry.first, var);
+        }
+    }
+}
+
+/* Begin Scope */
+
+const Var *Scope::find(string_view name) const {
+    if (entries.size() > LINEAR_LIMIT) {
+        auto result = index.find(name);
+        if (result != index.end()) {
+            return &entries[result->second].second;
+        }
+        return nullptr;
     }
 
-    auto resultClass = classTable.find(name);
-    if (resultClass != classTable.end()) {
-        return &resultClass->second;
+    for (const auto &entry : entries) {
+        if (entry.first == name) {
+            return &entry.second;
+        }
     }
 
     return nullptr;
 }
 
+bool Scope::insert(const string &name, const Var &var) {
+    if (find(name) != nullptr) {
+        return false;
+    }
 
-void SymbolTable::startClass() {
-    for (auto it = classTable.begin(); it != classTable.end();) {
-        if (it->second.kind != Kind::STATIC) {
-            it = classTable.erase(it);
-        } else {
-            it++;
+    entries.push_back({name, var});
+
+    // build the index the moment the scope outgrows linear scanning, keep it updated afterwards
+    if (entries.size() == LINEAR_LIMIT + 1) {
+        index.reserve(entries.size() * 2);
+        for (size_t i = 0; i < entries.size(); i++) {
+            index.insert({entries[i].first, i});
         }
+    } else if (entries.size() > LINEAR_LIMIT + 1) {
+        index.insert({name, entries.size() - 1});
     }
+
+    return true;
 }
 
-void SymbolTable::startSubroutine() {
-    subroutineTable.clear();
+void Scope::clear() {
+    entries.clear();
+    if (!index.empty()) {
+        index.clear();
+    }
 }
 
-void SymbolTable::define(string name, string type, Kind kind) {
-    Var newVar;
-    newVar.type = type;
-    newVar.kind = kind;
-    newVar.index = varCount(kind);
+/* End Scope */
+
+
+const Var *SymbolTable::find(string_view name) const {
+    const Var *result = subroutineTable.find(name);
+    if (result) return result;
 
+    result = fieldTable.find(name);
+    if (result) return result;
+
+    return staticTable.find(name);
+}
+
+Scope &SymbolTable::scopeOf(Kind kind) {
     switch (kind) {
         case Kind::ARG:
         case Kind::VAR:
-            subroutineTable.insert({name, newVar});
-            break;
+            return subroutineTable;
         case Kind::FIELD:
+            return fieldTable;
         case Kind::STATIC:
-            classTable.insert({name, newVar});
-            break;
+        default:
+            return staticTable;
     }
 }
 
-size_t SymbolTable::varCount(Kind kind) {
-    size_t count = 0;
-    switch(kind) {
-        case Kind::ARG:
-        case Kind::VAR: {
-                for (auto it = subroutineTable.begin(); it != subroutineTable.end(); it++) {
-                    if (it->second.kind == kind) {
-                        count++;
-                    }
-                }
-                break;
-            }
-        case Kind::FIELD:
-        case Kind::STATIC: {
-                for (auto it = classTable.begin(); it != classTable.end(); it++) {
-                    if (it->second.kind == kind) {
-                        count++;
-                    }
-                }
-                break;
-            }
-    }
 
-    return count;
+void SymbolTable::startClass() {
+    staticTable.clear();
+    fieldTable.clear();
+    counts[size_t(Kind::STATIC)] = 0;
+    counts[size_t(Kind::FIELD)] = 0;
 }
 
-Kind *SymbolTable::kindOf(string name) {
-    auto result = find(name);
-    if (result) return &result->kind;
-    else return nullptr;
+void SymbolTable::startSubroutine() {
+    subroutineTable.clear();
+    counts[size_t(Kind::ARG)] = 0;
+    counts[size_t(Kind::VAR)] = 0;
 }
 
-string *SymbolTable::typeOf(string name) {
-    auto result = find(name);
-    if (result) return &result->type;
-    else return nullptr;
+void SymbolTable::define(string name, string type, Kind kind) {
+    PhaseTimer timer (Phase::SYMBOLS);
+    Var newVar;
+    newVar.type = *typeNames.insert(type).first;
+    newVar.kind = kind;
+    newVar.segment = segmentOf(kind);
+    newVar.index = counts[size_t(kind)];
+
+    if (scopeOf(kind).insert(name, newVar)) {
+        counts[size_t(kind)]++;
+    }
+}
+
+size_t SymbolTable::varCount(Kind kind) {
+    return counts[size_t(kind)];
 }
 
-size_t *SymbolTable::indexOf(string name) {
-    auto result = find(name);
-    if (result) return &result->index;
-    else return nullptr;
+Symbol SymbolTable::resolve(string_view name) const {
+    PhaseTimer timer (Phase::SYMBOLS);
+    Symbol symbol;
+    const Var *result = find(name);
+    if (result) {
+        symbol.type = result->type;
+        symbol.kind = result->kind;
+        symbol.segment = result->segment;
+        symbol.index = result->index;
+        symbol.defined = true;
+    }
+
+    return symbol;
 }
 
 
@@ -125,7 +177,10 @@ ostream &operator<<(ostream &out, Kind kind) {
 void SymbolTable::printClassTable() {
 #if DEBUGST
     cout << "Class Table: " << endl;
-    for (auto it = classTable.begin(); it != classTable.end(); it++) {
+    for (auto it = staticTable.begin(); it != staticTable.end(); it++) {
+        cout << it->first << ", " << it->second.type << ", " << it->second.kind << ", " << it->second.index << endl;
+    }
+    for (auto it = fieldTable.begin(); it != fieldTable.end(); it++) {
         cout << it->first << ", " << it->second.type << ", " << it->second.kind << ", " << it->second.index << endl;
     }
 
@@ -0,0 +1,140 @@
+#include <ThreadPool/pool.hpp>
+#include <atomic>
+#include <exception>
+
+using namespace std;
+
+
+ThreadPool::ThreadPool(size_t nThreads) {
+    if (nThreads == 0) {
+        nThreads = 1;
+    }
+
+    for (size_t i = 0; i < nThreads; i++) {
+        workers.push_back(make_unique<Worker>());
+    }
+    for (size_t i = 0; i < nThreads; i++) {
+        threads.emplace_back(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> guard(idleLock);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+
+    for (auto &t : threads) {
+        t.join();
+    }
+}
+
+// own deque first (newest task, still warm in cache), then steal the oldest task of the others
+bool ThreadPool::tryPop(size_t self, function<void()> &task) {
+    for (size_t i = 0; i < workers.size(); i++) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (victim.tasks.empty()) {
+            continue;
+        }
+
+        if (i == 0) {
+            task = move(victim.tasks.back());
+            victim.tasks.pop_back();
+        } else {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+
+        lock_guard<mutex> idle(idleLock);
+        queued--;
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t self) {
+    function<void()> task;
+    while (true) {
+        if (tryPop(self, task)) {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> idle(idleLock);
+        wakeUp.wait(idle, [this]() { return queued > 0 || stopping; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    size_t target;
+    {
+        lock_guard<mutex> idle(idleLock);
+        target = nextWorker++ % workers.size();
+    }
+
+    {
+        lock_guard<mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(move(task));
+    }
+
+    {
+        lock_guard<mutex> idle(idleLock);
+        queued++;
+    }
+    wakeUp.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t n, const function<void(size_t)> &body) {
+    if (n == 0) {
+        return;
+    }
+
+    struct Batch {
+        atomic<size_t> remaining;
+        mutex lock;
+        condition_variable done;
+        vector<exception_ptr> errors;
+    };
+    auto batch = make_shared<Batch>();
+    batch->remaining = n;
+    batch->errors.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+        submit([batch, &body, i]() {
+            try {
+                body(i);
+            } catch (...) {
+                batch->errors[i] = current_exception();
+            }
+
+            if (--batch->remaining == 0) {
+                lock_guard<mutex> guard(batch->lock);
+                batch->done.notify_all();
+            }
+        });
+    }
+
+    // help out instead of blocking while there is queued work
+    function<void()> task;
+    while (batch->remaining > 0) {
+        if (tryPop(0, task)) {
+            task();
+            continue;
+        }
+
+        unique_lock<mutex> guard(batch->lock);
+        batch->done.wait(guard, [&batch]() { return batch->remaining == 0; });
+    }
+
+    for (auto &error : batch->errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+}
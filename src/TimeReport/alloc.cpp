@@ -0,0 +1,210 @@
+#include <TimeReport/alloc.hpp>
+#include <TimeReport/report.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <map>
+#include <sys/resource.h>
+
+using namespace std;
+
+namespace {
+    const size_t SLOTS = 4096;                      /* distinct call stacks, the rest only count per phase */
+    const size_t PROBES = 32;
+    const int FRAMES = 24;                          /* the standard library nests deep unoptimized */
+    const int SKIPPED = 2;                          /* count() and operator new (new.cpp) */
+
+    typedef struct stack_slot_struct {
+        atomic<uint64_t> key {0};                   /* hash of the frames, 0: free */
+        void *frames[FRAMES] = {};
+        int nFrames = 0;
+        atomic<uint64_t> calls {0};
+        atomic<uint64_t> bytes {0};
+    } StackSlot;
+
+    atomic<uint64_t> phaseCalls[PhaseTimes::PHASES + 1];
+    atomic<uint64_t> phaseBytes[PhaseTimes::PHASES + 1];
+    StackSlot stacks[SLOTS];
+
+    thread_local bool unwinding = false;            /* unwinding may allocate itself */
+    atomic<uint64_t> peakBeforeReset {0};           /* highest VmHWM a reset discarded */
+}
+
+
+/* Begin Helper Function */
+
+/* the qualified name of a demangled function, without return type, template and function arguments */
+static string functionName(const string &demangled) {
+    static const string ANONYMOUS = "(anonymous namespace)";
+    string name;
+    int depth = 0;
+    for (size_t i = 0; i < demangled.size(); i++) {
+        char c = demangled[i];
+        if (c == '<') {
+            depth++;
+        } else if (c == '>') {
+            depth--;
+        } else if (depth == 0 && demangled.compare(i, ANONYMOUS.size(), ANONYMOUS) == 0) {
+            // part of the name, not the argument list
+            name += ANONYMOUS;
+            i += ANONYMOUS.size() - 1;
+        } else if (depth == 0 && c == '(') {
+            break;
+        } else if (depth == 0 && c == ' ') {
+            name.clear();
+        } else if (depth == 0) {
+            name += c;
+        }
+    }
+    return name;
+}
+
+/* VmHWM of /proc/self/status in KB, 0 where there is none; stdio, so nothing is counted */
+static uint64_t highWaterMarkKb() {
+    FILE *status = fopen("/proc/self/status", "r");
+    if (!status) return 0;
+    char line[256];
+    unsigned long long kb = 0;
+    while (fgets(line, sizeof line, status)) {
+        if (sscanf(line, "VmHWM: %llu kB", &kb) == 1) break;
+    }
+    fclose(status);
+    return kb;
+}
+
+/* the function of the first frame in the executable that isn't the standard library's, demangled */
+static string callerOf(void *const *frames, int nFrames) {
+    Dl_info self;
+    dladdr((void *) &AllocationCounter::reset, &self);
+    string fallback = "??";
+    for (int i = 0; i < nFrames; i++) {
+        Dl_info info;
+        if (!dladdr(frames[i], &info) || info.dli_fbase != self.dli_fbase) continue;
+        if (!info.dli_sname) {
+            char offset[32];
+            snprintf(offset, sizeof offset, "+0x%zx", size_t(uintptr_t(frames[i]) - uintptr_t(self.dli_fbase)));
+            fallback = self.dli_fname + string(offset);
+            continue;
+        }
+        int status;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        string name = status == 0 ? functionName(demangled) : info.dli_sname;
+        free(demangled);
+        if (name.rfind("std::", 0) == 0 || name.rfind("__gnu_cxx::", 0) == 0 || name.rfind("operator new", 0) == 0) {
+            if (fallback == "??") fallback = name;
+            continue;
+        }
+        return name;
+    }
+    return fallback;
+}
+
+/* End Helper Function */
+
+
+__attribute__((noinline)) void AllocationCounter::count(size_t size) {
+    if (unwinding) return;
+    unwinding = true;
+
+    size_t phase = TimeReport::phase();
+    phaseCalls[phase].fetch_add(1, memory_order_relaxed);
+    phaseBytes[phase].fetch_add(size, memory_order_relaxed);
+    if (PhaseTimes *times = TimeReport::current()) {
+        times->allocations++;
+        times->allocatedBytes += size;
+    }
+
+    void *frames[SKIPPED + FRAMES];
+    int nFrames = max(backtrace(frames, SKIPPED + FRAMES) - SKIPPED, 0);
+    uint64_t key = 14695981039346656037ull;
+    for (int i = 0; i < nFrames; i++) {
+        key = (key ^ uint64_t(frames[SKIPPED + i])) * 1099511628211ull;
+    }
+    key = max<uint64_t>(key, 1);
+
+    for (size_t probe = 0; probe < PROBES; probe++) {
+        StackSlot &slot = stacks[(key + probe) % SLOTS];
+        uint64_t found = 0;
+        if (slot.key.compare_exchange_strong(found, key)) {
+            memcpy(slot.frames, frames + SKIPPED, nFrames * sizeof(void *));
+            slot.nFrames = nFrames;
+        } else if (found != key) {
+            continue;
+        }
+        slot.calls.fetch_add(1, memory_order_relaxed);
+        slot.bytes.fetch_add(size, memory_order_relaxed);
+        break;
+    }
+    unwinding = false;
+}
+
+uint64_t AllocationCounter::calls(size_t phase) {
+    return phaseCalls[phase].load(memory_order_relaxed);
+}
+
+uint64_t AllocationCounter::bytes(size_t phase) {
+    return phaseBytes[phase].load(memory_order_relaxed);
+}
+
+vector<AllocationSite> AllocationCounter::sites(size_t top) {
+    vector<pair<const StackSlot *, uint64_t>> used;
+    for (const StackSlot &slot : stacks) {
+        if (slot.key.load() != 0) used.push_back({&slot, slot.calls.load()});
+    }
+
+    // stacks ending in the same function are one site
+    map<string, AllocationSite> byFunction;
+    for (const auto &entry : used) {
+        AllocationSite &site = byFunction[callerOf(entry.first->frames, entry.first->nFrames)];
+        site.calls += entry.second;
+        site.bytes += entry.first->bytes.load();
+    }
+    vector<AllocationSite> sites;
+    for (auto &entry : byFunction) {
+        entry.second.function = entry.first;
+        sites.push_back(entry.second);
+    }
+    stable_sort(sites.begin(), sites.end(), [](const AllocationSite &a, const AllocationSite &b) { return a.calls > b.calls; });
+    if (sites.size() > top) sites.resize(top);
+    return sites;
+}
+
+uint64_t AllocationCounter::peakRssKb() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return max({uint64_t(usage.ru_maxrss), peakBeforeReset.load(), highWaterMarkKb()});
+}
+
+void AllocationCounter::resetPeakRss() {
+    uint64_t kb = highWaterMarkKb();
+    uint64_t seen = peakBeforeReset.load();
+    while (kb > seen && !peakBeforeReset.compare_exchange_weak(seen, kb)) {}
+
+    // 5 resets the high-water mark to the current resident size (Linux 4.0)
+    FILE *clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (!clearRefs) return;
+    fputs("5", clearRefs);
+    fclose(clearRefs);
+}
+
+uint64_t AllocationCounter::peakRssSinceResetKb() {
+    uint64_t kb = highWaterMarkKb();
+    return kb > 0 ? kb : peakRssKb();
+}
+
+void AllocationCounter::reset() {
+    for (size_t i = 0; i <= PhaseTimes::PHASES; i++) {
+        phaseCalls[i] = 0;
+        phaseBytes[i] = 0;
+    }
+    for (StackSlot &slot : stacks) {
+        slot.key = 0;
+        slot.calls = 0;
+        slot.bytes = 0;
+    }
+}
+
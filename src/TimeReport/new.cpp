@@ -0,0 +1,30 @@
+#include <TimeReport/alloc.hpp>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+
+/*
+ *  The global allocation functions of the jackc executable, kept out of
+ *  libjackc.a so a program embedding the compiler keeps its own.
+ */
+
+void *operator new(size_t size) {
+    if (AllocationCounter::counting.load(memory_order_relaxed)) AllocationCounter::count(size);
+    if (size == 0) size = 1;
+    while (true) {
+        if (void *memory = malloc(size)) return memory;
+        new_handler handler = get_new_handler();
+        if (!handler) throw bad_alloc();
+        handler();
+    }
+}
+
+void operator delete(void *memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+    free(memory);
+}
@@ -0,0 +1,279 @@
+#include <TimeReport/report.hpp>
+#include <TimeReport/alloc.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    const char *const PHASE_NAMES[] = {"read", "index", "cache", "lex", "parse", "symbols", "write", "link", "other"};
+    const size_t TOP_SITES = 10;
+
+    // the phase this thread is in and since when, and the file it works on
+    thread_local PhaseTimes *record = nullptr;
+    thread_local bool timing = false;
+    thread_local Phase activePhase = Phase::READ;
+    thread_local chrono::steady_clock::time_point since;
+}
+
+
+/* Begin Helper Function */
+
+static uint64_t nanosecondsSince(chrono::steady_clock::time_point start, chrono::steady_clock::time_point now) {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(now - start).count());
+}
+
+static uint64_t totalOf(const PhaseTimes &times) {
+    uint64_t total = 0;
+    for (uint64_t ns : times.nanoseconds) total += ns;
+    return total;
+}
+
+static void add(PhaseTimes &to, const PhaseTimes &times) {
+    for (size_t i = 0; i < PhaseTimes::PHASES; i++) {
+        to.nanoseconds[i] += times.nanoseconds[i];
+    }
+    to.bytes += times.bytes;
+    to.lines += times.lines;
+    to.tokens += times.tokens;
+    to.instructions += times.instructions;
+    to.allocations += times.allocations;
+    to.allocatedBytes += times.allocatedBytes;
+    to.peakRssKb = max(to.peakRssKb, times.peakRssKb);
+}
+
+static string milliseconds(uint64_t nanoseconds) {
+    ostringstream text;
+    text << fixed << setprecision(3) << nanoseconds / 1e6;
+    return text.str();
+}
+
+static string jsonString(const string &text) {
+    string escaped = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+
+static void writeJson(ostream &out, const PhaseTimes &times, bool allocations) {
+    out << "{\"ms\": " << milliseconds(totalOf(times)) << ", \"phases\": {";
+    for (size_t i = 0; i < PhaseTimes::PHASES; i++) {
+        out << (i == 0 ? "" : ", ") << "\"" << PHASE_NAMES[i] << "\": " << milliseconds(times.nanoseconds[i]);
+    }
+    out << "}, \"bytes\": " << times.bytes << ", \"lines\": " << times.lines
+        << ", \"tokens\": " << times.tokens << ", \"instructions\": " << times.instructions;
+    if (allocations) {
+        out << ", \"allocations\": " << times.allocations << ", \"allocatedBytes\": " << times.allocatedBytes
+            << ", \"peakRssKb\": " << times.peakRssKb;
+    }
+    out << "}";
+}
+
+/* End Helper Function */
+
+
+TimeReport &TimeReport::shared() {
+    static TimeReport report;
+    return report;
+}
+
+void TimeReport::charge(Phase phase, uint64_t nanoseconds) {
+    if (record) {
+        record->nanoseconds[size_t(phase)] += nanoseconds;
+        return;
+    }
+    TimeReport &report = shared();
+    lock_guard<mutex> guard(report.lock);
+    report.overall.nanoseconds[size_t(phase)] += nanoseconds;
+}
+
+PhaseTimes *TimeReport::current() {
+    return record;
+}
+
+size_t TimeReport::phase() {
+    return timing ? size_t(activePhase) : PhaseTimes::PHASES;
+}
+
+void TimeReport::merge(const string &file, const PhaseTimes &times) {
+    TimeReport &report = shared();
+    lock_guard<mutex> guard(report.lock);
+    add(report.files[file], times);
+}
+
+void TimeReport::print(ostream &out) {
+    // what the report allocates itself isn't counted
+    bool counted = AllocationCounter::counting.exchange(false);
+    TimeReport &report = shared();
+    lock_guard<mutex> guard(report.lock);
+
+    PhaseTimes total = report.overall;
+    vector<pair<string, PhaseTimes>> files(report.files.begin(), report.files.end());
+    for (const auto &file : files) {
+        add(total, file.second);
+    }
+    auto weight = [](const PhaseTimes &times, size_t phase) {
+        return enabled ? times.nanoseconds[phase] : AllocationCounter::calls(phase);
+    };
+    stable_sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+        return enabled ? totalOf(a.second) > totalOf(b.second) : a.second.allocations > b.second.allocations;
+    });
+    vector<size_t> phases;
+    for (size_t i = 0; i < PhaseTimes::PHASES; i++) {
+        phases.push_back(i);
+    }
+    stable_sort(phases.begin(), phases.end(), [&](size_t a, size_t b) { return weight(total, a) > weight(total, b); });
+    vector<AllocationSite> sites;
+    uint64_t peakRssKb = 0;
+    if (counted) {
+        sites = AllocationCounter::sites(TOP_SITES);
+        peakRssKb = AllocationCounter::peakRssKb();
+    }
+
+    if ((enabled && json) || (counted && AllocationCounter::json)) {
+        out << "{\"total\": ";
+        writeJson(out, total, counted);
+        out << ", \"files\": [";
+        for (size_t i = 0; i < files.size(); i++) {
+            out << (i == 0 ? "" : ", ") << "{\"file\": " << jsonString(files[i].first) << ", \"times\": ";
+            writeJson(out, files[i].second, counted);
+            out << "}";
+        }
+        out << "]";
+        if (counted) {
+            out << ", \"allocations\": {\"phases\": {";
+            for (size_t i = 0; i <= PhaseTimes::PHASES; i++) {
+                out << (i == 0 ? "" : ", ") << "\"" << PHASE_NAMES[i] << "\": {\"calls\": " << AllocationCounter::calls(i)
+                    << ", \"bytes\": " << AllocationCounter::bytes(i) << "}";
+            }
+            out << "}, \"sites\": [";
+            for (size_t i = 0; i < sites.size(); i++) {
+                out << (i == 0 ? "" : ", ") << "{\"function\": " << jsonString(sites[i].function)
+                    << ", \"calls\": " << sites[i].calls << ", \"bytes\": " << sites[i].bytes << "}";
+            }
+            out << "], \"peakRssKb\": " << peakRssKb << "}";
+        }
+        out << "}" << endl;
+    } else {
+        if (enabled) {
+            // time summed over the threads, several files are compiled at once
+            uint64_t sum = max<uint64_t>(totalOf(total), 1);
+            out << left << setw(10) << "phase" << right << setw(12) << "ms" << setw(8) << "share" << endl;
+            for (size_t i : phases) {
+                out << left << setw(10) << PHASE_NAMES[i] << right << setw(12) << milliseconds(total.nanoseconds[i])
+                    << setw(7) << fixed << setprecision(1) << 100.0 * total.nanoseconds[i] / sum << "%" << endl;
+            }
+            out << left << setw(10) << "total" << right << setw(12) << milliseconds(totalOf(total)) << endl;
+            out << total.bytes << " bytes, " << total.lines << " lines, " << total.tokens << " tokens, "
+                << total.instructions << " VM instructions" << endl << endl;
+        }
+        if (counted) {
+            // allocations outside every phase (startup, the thread pool, printing) are other
+            out << left << setw(10) << "phase" << right << setw(14) << "allocations" << setw(14) << "bytes" << endl;
+            uint64_t calls = 0;
+            uint64_t bytes = 0;
+            phases.push_back(PhaseTimes::PHASES);
+            for (size_t i : phases) {
+                out << left << setw(10) << PHASE_NAMES[i] << right << setw(14) << AllocationCounter::calls(i)
+                    << setw(14) << AllocationCounter::bytes(i) << endl;
+                calls += AllocationCounter::calls(i);
+                bytes += AllocationCounter::bytes(i);
+            }
+            phases.pop_back();
+            out << left << setw(10) << "total" << right << setw(14) << calls << setw(14) << bytes << endl;
+            out << "peak RSS " << peakRssKb << " KB" << endl << endl;
+
+            size_t width = 24;
+            for (const AllocationSite &site : sites) width = max(width, site.function.size() + 2);
+            out << left << setw(width) << "allocated by" << right << setw(12) << "calls" << setw(14) << "bytes" << endl;
+            for (const AllocationSite &site : sites) {
+                out << left << setw(width) << site.function << right << setw(12) << site.calls << setw(14) << site.bytes << endl;
+            }
+            out << endl;
+        }
+
+        int width = 24;
+        for (const auto &file : files) width = max(width, int(file.first.size()) + 2);
+        out << left << setw(width) << "file" << right;
+        if (enabled) {
+            out << setw(10) << "ms";
+            for (size_t i : phases) out << setw(10) << PHASE_NAMES[i];
+        }
+        out << setw(10) << "bytes" << setw(8) << "lines" << setw(9) << "tokens" << setw(9) << "instrs";
+        if (counted) out << setw(10) << "allocs" << setw(12) << "alloc bytes" << setw(10) << "peak KB";
+        out << endl;
+        for (const auto &file : files) {
+            out << left << setw(width) << file.first << right;
+            if (enabled) {
+                out << setw(10) << milliseconds(totalOf(file.second));
+                for (size_t i : phases) out << setw(10) << milliseconds(file.second.nanoseconds[i]);
+            }
+            out << setw(10) << file.second.bytes << setw(8) << file.second.lines
+                << setw(9) << file.second.tokens << setw(9) << file.second.instructions;
+            if (counted) {
+                out << setw(10) << file.second.allocations << setw(12) << file.second.allocatedBytes
+                    << setw(10) << file.second.peakRssKb;
+            }
+            out << endl;
+        }
+    }
+
+    report.files.clear();
+    report.overall = PhaseTimes();
+    if (counted) {
+        AllocationCounter::reset();
+        AllocationCounter::counting = true;
+    }
+}
+
+void PhaseTimer::start(Phase phase) {
+    auto now = chrono::steady_clock::now();
+    if (timing) TimeReport::charge(activePhase, nanosecondsSince(since, now));
+    previous = activePhase;
+    nested = timing;
+    activePhase = phase;
+    timing = true;
+    since = now;
+}
+
+void PhaseTimer::stop() {
+    auto now = chrono::steady_clock::now();
+    TimeReport::charge(activePhase, nanosecondsSince(since, now));
+    activePhase = previous;
+    timing = nested;
+    since = now;
+}
+
+FileScope::FileScope(const string &fileName) : on {TimeReport::active()} {
+    if (!on) return;
+    // a phase running around the scope is charged to what it ran for so far
+    if (timing) {
+        auto now = chrono::steady_clock::now();
+        TimeReport::charge(activePhase, nanosecondsSince(since, now));
+        since = now;
+    }
+    file = fileName;
+    outer = record;
+    record = &times;
+    if (AllocationCounter::counting.load(memory_order_relaxed)) {
+        AllocationCounter::resetPeakRss();
+    }
+}
+
+FileScope::~FileScope() {
+    if (!on) return;
+    if (timing) {
+        auto now = chrono::steady_clock::now();
+        TimeReport::charge(activePhase, nanosecondsSince(since, now));
+        since = now;
+    }
+    if (AllocationCounter::counting.load(memory_order_relaxed)) {
+        times.peakRssKb = AllocationCounter::peakRssSinceResetKb();
+    }
+    record = outer;
+    TimeReport::merge(file, times);
+}
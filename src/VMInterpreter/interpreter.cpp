@@ -0,0 +1,787 @@
+#include <VMInterpreter/interpreter.hpp>
+#include <cstdlib>
+#include <stdexcept>
+
+using namespace std;
+
+#if defined(__GNUC__)
+#define THREADED_DISPATCH
+#endif
+
+// every handler ends in NEXT, which counts and dispatches the operation ip points at
+#ifdef THREADED_DISPATCH
+#define HANDLER(name) name:
+#define NEXT() do { nExecuted += ip->weight; goto *ip->handler; } while (0)
+#else
+#define HANDLER(name) case Code::name:
+#define NEXT() do { nExecuted += ip->weight; goto dispatch; } while (0)
+#endif
+
+#define RAM(address) mem[uint16_t(address) & 0x7fff]
+
+namespace {
+    const int HEAP_BASE = 2048;
+    const int SCREEN = 16384;
+    const int TEMP = 5;
+
+    // how run() leaves the dispatch loop from inside a native
+    typedef struct halt_struct {
+        int status;
+    } Halt;
+}
+
+
+/* Begin Helper Function */
+
+static bool isArithmetic(const Instruction *instruction, Command command) {
+    return instruction && instruction->opcode == Opcode::ARITHMETIC && Command(instruction->kind) == command;
+}
+
+static bool isComparison(const Instruction *instruction) {
+    return isArithmetic(instruction, Command::EQ) || isArithmetic(instruction, Command::GT) || isArithmetic(instruction, Command::LT);
+}
+
+/* End Helper Function */
+
+
+/* Begin Private Methods */
+
+const map<string, VMInterpreter::Native> &VMInterpreter::natives() {
+    static const map<string, Native> table {
+        {"Sys.halt", &VMInterpreter::sysHalt},
+        {"Sys.error", &VMInterpreter::sysError},
+        {"Sys.wait", &VMInterpreter::sysWait},
+        {"Memory.init", &VMInterpreter::memoryInit},
+        {"Memory.peek", &VMInterpreter::memoryPeek},
+        {"Memory.poke", &VMInterpreter::memoryPoke},
+        {"Memory.alloc", &VMInterpreter::memoryAlloc},
+        {"Memory.deAlloc", &VMInterpreter::memoryDeAlloc},
+        {"Array.new", &VMInterpreter::arrayNew},
+        {"Array.dispose", &VMInterpreter::memoryDeAlloc},
+        {"Math.init", &VMInterpreter::nothing},
+        {"Math.abs", &VMInterpreter::mathAbs},
+        {"Math.multiply", &VMInterpreter::mathMultiply},
+        {"Math.divide", &VMInterpreter::mathDivide},
+        {"Math.min", &VMInterpreter::mathMin},
+        {"Math.max", &VMInterpreter::mathMax},
+        {"Math.sqrt", &VMInterpreter::mathSqrt},
+        {"String.new", &VMInterpreter::stringNew},
+        {"String.dispose", &VMInterpreter::memoryDeAlloc},
+        {"String.length", &VMInterpreter::stringLength},
+        {"String.charAt", &VMInterpreter::stringCharAt},
+        {"String.setCharAt", &VMInterpreter::stringSetCharAt},
+        {"String.appendChar", &VMInterpreter::stringAppendChar},
+        {"String.eraseLastChar", &VMInterpreter::stringEraseLastChar},
+        {"String.intValue", &VMInterpreter::stringIntValue},
+        {"String.setInt", &VMInterpreter::stringSetInt},
+        {"String.newLine", &VMInterpreter::stringNewLine},
+        {"String.backSpace", &VMInterpreter::stringBackSpace},
+        {"String.doubleQuote", &VMInterpreter::stringDoubleQuote},
+        {"Output.init", &VMInterpreter::nothing},
+        {"Output.moveCursor", &VMInterpreter::outputMoveCursor},
+        {"Output.printChar", &VMInterpreter::outputPrintChar},
+        {"Output.printString", &VMInterpreter::outputPrintString},
+        {"Output.printInt", &VMInterpreter::outputPrintInt},
+        {"Output.println", &VMInterpreter::outputPrintln},
+        {"Output.backSpace", &VMInterpreter::outputBackSpace},
+        {"Screen.init", &VMInterpreter::screenInit},
+        {"Screen.clearScreen", &VMInterpreter::screenClearScreen},
+        {"Screen.setColor", &VMInterpreter::screenSetColor},
+        {"Screen.drawPixel", &VMInterpreter::screenDrawPixel},
+        {"Screen.drawLine", &VMInterpreter::screenDrawLine},
+        {"Screen.drawRectangle", &VMInterpreter::screenDrawRectangle},
+        {"Screen.drawCircle", &VMInterpreter::screenDrawCircle},
+        {"Keyboard.init", &VMInterpreter::nothing},
+        {"Keyboard.keyPressed", &VMInterpreter::keyboardKeyPressed},
+        {"Keyboard.readChar", &VMInterpreter::keyboardReadChar},
+        {"Keyboard.readLine", &VMInterpreter::keyboardReadLine},
+        {"Keyboard.readInt", &VMInterpreter::keyboardReadInt},
+    };
+    return table;
+}
+
+void VMInterpreter::decodeFunction(const VMProgram &program, size_t begin, size_t end, int staticBase) {
+    const auto &instructions = program.code;
+    const auto &names = program.names;
+    const string &name = names[instructions[begin].name];
+    if (!functions.emplace(name, code.size()).second) {
+        throw runtime_error(name + " is defined twice");
+    }
+    code.push_back(Op {nullptr, Code::FUNCTION, 1, int32_t(instructions[begin].operand), 0});
+
+    map<uint32_t, size_t> labels;
+    vector<pair<size_t, uint32_t>> jumps;
+    auto at = [&](size_t k) { return k < end ? &instructions[k] : nullptr; };
+    auto emit = [&](Code opcode, int weight, int32_t a = 0, int32_t b = 0) {
+        code.push_back(Op {nullptr, opcode, uint8_t(weight), a, b});
+    };
+    auto address = [&](Segment segment, uint32_t index) {
+        return int32_t(segment == Segment::TEMP ? TEMP + index : staticBase + index);
+    };
+
+    for (size_t k = begin + 1; k < end; k++) {
+        const Instruction &instruction = instructions[k];
+        const Instruction *next = at(k + 1);
+        const Instruction *after = at(k + 2);
+        int32_t index = int32_t(instruction.operand);
+
+        switch (instruction.opcode) {
+            case Opcode::PUSH:
+                switch (Segment(instruction.kind)) {
+                    case Segment::CONST:
+                        if (isArithmetic(next, Command::ADD)) {
+                            emit(Code::ADD_CONST, 2, index), k++;
+                        } else if (isArithmetic(next, Command::SUB)) {
+                            emit(Code::SUB_CONST, 2, index), k++;
+                        } else if (isComparison(next)) {
+                            Command command = Command(next->kind);
+                            emit(command == Command::EQ ? Code::EQ_CONST : command == Command::GT ? Code::GT_CONST : Code::LT_CONST, 2, index), k++;
+                        } else if (next && next->opcode == Opcode::RETURN) {
+                            emit(Code::RETURN_CONST, 2, index), k++;
+                        } else {
+                            emit(Code::PUSH_CONST, 1, index);
+                        }
+                        break;
+                    case Segment::LOCAL:
+                        if (isArithmetic(next, Command::ADD)) {
+                            emit(Code::ADD_LOCAL, 2, index), k++;
+                        } else {
+                            emit(Code::PUSH_LOCAL, 1, index);
+                        }
+                        break;
+                    case Segment::ARG:
+                        if (isArithmetic(next, Command::ADD)) {
+                            emit(Code::ADD_ARG, 2, index), k++;
+                        } else {
+                            emit(Code::PUSH_ARG, 1, index);
+                        }
+                        break;
+                    case Segment::THIS:
+                        emit(Code::PUSH_THIS, 1, index);
+                        break;
+                    case Segment::THAT:
+                        emit(Code::PUSH_THAT, 1, index);
+                        break;
+                    case Segment::POINTER:
+                        emit(index == 0 ? Code::PUSH_POINTER0 : Code::PUSH_POINTER1, 1);
+                        break;
+                    default:
+                        emit(Code::PUSH_RAM, 1, address(Segment(instruction.kind), instruction.operand));
+                        break;
+                }
+                break;
+            case Opcode::POP:
+                switch (Segment(instruction.kind)) {
+                    case Segment::CONST:
+                        throw runtime_error(name + ": pop constant");
+                    case Segment::LOCAL:
+                        emit(Code::POP_LOCAL, 1, index);
+                        break;
+                    case Segment::ARG:
+                        emit(Code::POP_ARG, 1, index);
+                        break;
+                    case Segment::THIS:
+                        emit(Code::POP_THIS, 1, index);
+                        break;
+                    case Segment::THAT:
+                        emit(Code::POP_THAT, 1, index);
+                        break;
+                    case Segment::POINTER:
+                        // an array read: pop pointer 1; push that 0
+                        if (index == 1 && next && next->opcode == Opcode::PUSH
+                                && Segment(next->kind) == Segment::THAT && next->operand == 0) {
+                            emit(Code::THAT_AT, 2), k++;
+                        } else {
+                            emit(index == 0 ? Code::POP_POINTER0 : Code::POP_POINTER1, 1);
+                        }
+                        break;
+                    default:
+                        emit(Code::POP_RAM, 1, address(Segment(instruction.kind), instruction.operand));
+                        break;
+                }
+                break;
+            case Opcode::ARITHMETIC: {
+                Command command = Command(instruction.kind);
+                bool negated = isArithmetic(next, Command::NOT) && after && after->opcode == Opcode::IF_GOTO;
+                if (isComparison(&instruction) && (negated || (next && next->opcode == Opcode::IF_GOTO))) {
+                    // the comparison and its jump, the jump target is patched below
+                    static const Code jump[2][3] = {
+                        {Code::JUMP_EQ, Code::JUMP_GT, Code::JUMP_LT},
+                        {Code::JUMP_NE, Code::JUMP_LE, Code::JUMP_GE},
+                    };
+                    int which = command == Command::EQ ? 0 : command == Command::GT ? 1 : 2;
+                    k += negated ? 2 : 1;
+                    jumps.push_back({code.size(), instructions[k].name});
+                    emit(jump[negated][which], negated ? 3 : 2);
+                } else if (command == Command::NOT && next && next->opcode == Opcode::IF_GOTO) {
+                    k++;
+                    jumps.push_back({code.size(), instructions[k].name});
+                    emit(Code::JUMP_UNLESS_TRUE, 2);
+                } else {
+                    static const Code codes[] = {Code::ADD, Code::SUB, Code::NEG, Code::EQ, Code::GT, Code::LT, Code::AND, Code::OR, Code::NOT};
+                    emit(codes[instruction.kind], 1);
+                }
+                break;
+            }
+            case Opcode::LABEL:
+                labels[instruction.name] = code.size();
+                break;
+            case Opcode::GOTO:
+            case Opcode::IF_GOTO:
+                jumps.push_back({code.size(), instruction.name});
+                emit(instruction.opcode == Opcode::GOTO ? Code::GOTO : Code::IF_GOTO, 1);
+                break;
+            case Opcode::CALL:
+                calls.push_back(CallFixup {code.size(), names[instruction.name]});
+                emit(Code::CALL, 1, 0, index);
+                break;
+            case Opcode::RETURN:
+                emit(Code::RETURN, 1);
+                break;
+            case Opcode::FUNCTION:
+                break;
+        }
+    }
+    // falling off the end of a function returns 0, like the other backends
+    emit(Code::RETURN_CONST, 0, 0);
+
+    for (const auto &jump : jumps) {
+        auto label = labels.find(jump.second);
+        if (label == labels.end()) {
+            throw runtime_error(name + ": jump to unknown label " + names[jump.second]);
+        }
+        code[jump.first].a = int32_t(label->second);
+    }
+}
+
+int16_t VMInterpreter::alloc(int16_t size) {
+    int16_t *mem = ram.data();
+    if (size <= 0) error(5);
+
+    int need = size + 1;
+    int16_t previous = 0;
+    for (int16_t block = freeList; block != 0; previous = block, block = RAM(block + 1)) {
+        int length = RAM(block);
+        if (length - need >= 2) {
+            RAM(block) = int16_t(length - need);
+            int16_t allocated = int16_t(block + length - need);
+            RAM(allocated) = int16_t(need);
+            return int16_t(allocated + 1);
+        }
+        if (length >= need) {
+            if (previous == 0) {
+                freeList = RAM(block + 1);
+            } else {
+                RAM(previous + 1) = RAM(block + 1);
+            }
+            return int16_t(block + 1);
+        }
+    }
+    error(6);
+}
+
+void VMInterpreter::drawPixel(int x, int y) {
+    int16_t &word = ram[SCREEN + y * 32 + x / 16];
+    int16_t bit = int16_t(1 << (x % 16));
+    word = color ? int16_t(word | bit) : int16_t(word & ~bit);
+}
+
+void VMInterpreter::drawHorizontal(int x1, int x2, int y) {
+    for (int x = x1; x <= x2; x++) {
+        drawPixel(x, y);
+    }
+}
+
+void VMInterpreter::error(int16_t code) {
+    out << "ERR" << code << endl;
+    throw Halt {1};
+}
+
+int16_t VMInterpreter::sysHalt(const int16_t *) {
+    throw Halt {0};
+}
+
+int16_t VMInterpreter::sysError(const int16_t *args) {
+    error(args[0]);
+}
+
+int16_t VMInterpreter::sysWait(const int16_t *args) {
+    if (args[0] < 0) error(1);
+    return 0;
+}
+
+int16_t VMInterpreter::memoryInit(const int16_t *) {
+    freeList = HEAP_BASE;
+    ram[HEAP_BASE] = HEAP_END - HEAP_BASE;
+    ram[HEAP_BASE + 1] = 0;
+    return 0;
+}
+
+int16_t VMInterpreter::memoryPeek(const int16_t *args) {
+    return ram[uint16_t(args[0]) & 0x7fff];
+}
+
+int16_t VMInterpreter::memoryPoke(const int16_t *args) {
+    ram[uint16_t(args[0]) & 0x7fff] = args[1];
+    return 0;
+}
+
+int16_t VMInterpreter::memoryAlloc(const int16_t *args) {
+    return alloc(args[0]);
+}
+
+int16_t VMInterpreter::memoryDeAlloc(const int16_t *args) {
+    int16_t *mem = ram.data();
+    int16_t block = int16_t(args[0] - 1);
+    RAM(block + 1) = freeList;
+    freeList = block;
+    return 0;
+}
+
+int16_t VMInterpreter::arrayNew(const int16_t *args) {
+    if (args[0] <= 0) error(2);
+    return alloc(args[0]);
+}
+
+int16_t VMInterpreter::nothing(const int16_t *) {
+    return 0;
+}
+
+int16_t VMInterpreter::mathAbs(const int16_t *args) {
+    return int16_t(args[0] < 0 ? -args[0] : args[0]);
+}
+
+int16_t VMInterpreter::mathMultiply(const int16_t *args) {
+    return int16_t(args[0] * args[1]);
+}
+
+int16_t VMInterpreter::mathDivide(const int16_t *args) {
+    if (args[1] == 0) error(3);
+    return int16_t(args[0] / args[1]);
+}
+
+int16_t VMInterpreter::mathMin(const int16_t *args) {
+    return min(args[0], args[1]);
+}
+
+int16_t VMInterpreter::mathMax(const int16_t *args) {
+    return max(args[0], args[1]);
+}
+
+int16_t VMInterpreter::mathSqrt(const int16_t *args) {
+    if (args[0] < 0) error(4);
+    int root = 0;
+    while ((root + 1) * (root + 1) <= args[0]) root++;
+    return int16_t(root);
+}
+
+int16_t VMInterpreter::stringNew(const int16_t *args) {
+    int16_t *mem = ram.data();
+    if (args[0] < 0) error(14);
+    int16_t s = alloc(int16_t(args[0] + 2));
+    RAM(s) = args[0];
+    RAM(s + 1) = 0;
+    return s;
+}
+
+int16_t VMInterpreter::stringLength(const int16_t *args) {
+    int16_t *mem = ram.data();
+    return RAM(args[0] + 1);
+}
+
+int16_t VMInterpreter::stringCharAt(const int16_t *args) {
+    int16_t *mem = ram.data();
+    if (args[1] < 0 || args[1] >= RAM(args[0] + 1)) error(15);
+    return RAM(args[0] + 2 + args[1]);
+}
+
+int16_t VMInterpreter::stringSetCharAt(const int16_t *args) {
+    int16_t *mem = ram.data();
+    if (args[1] < 0 || args[1] >= RAM(args[0] + 1)) error(16);
+    RAM(args[0] + 2 + args[1]) = args[2];
+    return 0;
+}
+
+int16_t VMInterpreter::stringAppendChar(const int16_t *args) {
+    int16_t *mem = ram.data();
+    int16_t length = RAM(args[0] + 1);
+    if (length >= RAM(args[0])) error(17);
+    RAM(args[0] + 2 + length) = args[1];
+    RAM(args[0] + 1) = int16_t(length + 1);
+    return args[0];
+}
+
+int16_t VMInterpreter::stringEraseLastChar(const int16_t *args) {
+    int16_t *mem = ram.data();
+    if (RAM(args[0] + 1) == 0) error(18);
+    RAM(args[0] + 1)--;
+    return 0;
+}
+
+int16_t VMInterpreter::stringIntValue(const int16_t *args) {
+    int16_t *mem = ram.data();
+    int length = RAM(args[0] + 1);
+    bool negative = length > 0 && RAM(args[0] + 2) == '-';
+    int value = 0;
+    for (int i = negative; i < length; i++) {
+        int16_t c = RAM(args[0] + 2 + i);
+        if (c < '0' || c > '9') break;
+        value = value * 10 + (c - '0');
+    }
+    return int16_t(negative ? -value : value);
+}
+
+int16_t VMInterpreter::stringSetInt(const int16_t *args) {
+    int16_t *mem = ram.data();
+    string digits = to_string(args[1]);
+    if (int(digits.size()) > RAM(args[0])) error(19);
+    for (size_t i = 0; i < digits.size(); i++) {
+        RAM(args[0] + 2 + int(i)) = digits[i];
+    }
+    RAM(args[0] + 1) = int16_t(digits.size());
+    return 0;
+}
+
+int16_t VMInterpreter::stringNewLine(const int16_t *) {
+    return 128;
+}
+
+int16_t VMInterpreter::stringBackSpace(const int16_t *) {
+    return 129;
+}
+
+int16_t VMInterpreter::stringDoubleQuote(const int16_t *) {
+    return '"';
+}
+
+int16_t VMInterpreter::outputMoveCursor(const int16_t *args) {
+    if (args[0] < 0 || args[0] > 22 || args[1] < 0 || args[1] > 63) error(20);
+    return 0;
+}
+
+int16_t VMInterpreter::outputPrintChar(const int16_t *args) {
+    out.put(char(args[0] == 128 ? '\n' : args[0] == 129 ? '\b' : args[0]));
+    return 0;
+}
+
+int16_t VMInterpreter::outputPrintString(const int16_t *args) {
+    int16_t *mem = ram.data();
+    int16_t length = RAM(args[0] + 1);
+    for (int16_t i = 0; i < length; i++) {
+        int16_t c = RAM(args[0] + 2 + i);
+        outputPrintChar(&c);
+    }
+    return 0;
+}
+
+int16_t VMInterpreter::outputPrintInt(const int16_t *args) {
+    out << args[0];
+    return 0;
+}
+
+int16_t VMInterpreter::outputPrintln(const int16_t *) {
+    out.put('\n');
+    return 0;
+}
+
+int16_t VMInterpreter::outputBackSpace(const int16_t *) {
+    out.put('\b');
+    return 0;
+}
+
+int16_t VMInterpreter::screenClearScreen(const int16_t *) {
+    fill(ram.begin() + SCREEN, ram.begin() + SCREEN + 8192, 0);
+    return 0;
+}
+
+int16_t VMInterpreter::screenInit(const int16_t *) {
+    color = -1;
+    return 0;
+}
+
+int16_t VMInterpreter::screenSetColor(const int16_t *args) {
+    color = args[0];
+    return 0;
+}
+
+int16_t VMInterpreter::screenDrawPixel(const int16_t *args) {
+    if (args[0] < 0 || args[0] > 511 || args[1] < 0 || args[1] > 255) error(7);
+    drawPixel(args[0], args[1]);
+    return 0;
+}
+
+int16_t VMInterpreter::screenDrawLine(const int16_t *args) {
+    int x1 = args[0], y1 = args[1], x2 = args[2], y2 = args[3];
+    if (x1 < 0 || x1 > 511 || y1 < 0 || y1 > 255 || x2 < 0 || x2 > 511 || y2 < 0 || y2 > 255) error(8);
+    int dx = abs(x2 - x1), sx = x1 < x2 ? 1 : -1;
+    int dy = -abs(y2 - y1), sy = y1 < y2 ? 1 : -1;
+    int err = dx + dy;
+    int x = x1, y = y1;
+    while (true) {
+        drawPixel(x, y);
+        if (x == x2 && y == y2) break;
+        if (2 * err >= dy) { err += dy; x += sx; }
+        if (2 * err <= dx) { err += dx; y += sy; }
+    }
+    return 0;
+}
+
+int16_t VMInterpreter::screenDrawRectangle(const int16_t *args) {
+    int x1 = args[0], y1 = args[1], x2 = args[2], y2 = args[3];
+    if (x1 > x2 || y1 > y2 || x1 < 0 || x2 > 511 || y1 < 0 || y2 > 255) error(9);
+    for (int y = y1; y <= y2; y++) {
+        drawHorizontal(x1, x2, y);
+    }
+    return 0;
+}
+
+int16_t VMInterpreter::screenDrawCircle(const int16_t *args) {
+    int x = args[0], y = args[1], r = args[2];
+    if (x < 0 || x > 511 || y < 0 || y > 255) error(12);
+    if (r < 0 || r > 181) error(13);
+    for (int dy = -r; dy <= r; dy++) {
+        int half = 0;
+        while ((half + 1) * (half + 1) <= r * r - dy * dy) half++;
+        if (y + dy >= 0 && y + dy <= 255) {
+            drawHorizontal(max(x - half, 0), min(x + half, 511), y + dy);
+        }
+    }
+    return 0;
+}
+
+int16_t VMInterpreter::keyboardKeyPressed(const int16_t *) {
+    return 0;
+}
+
+int16_t VMInterpreter::keyboardReadChar(const int16_t *) {
+    int c = in.get();
+    if (c == EOF) throw Halt {0};
+    return int16_t(c == '\n' ? 128 : c);
+}
+
+int16_t VMInterpreter::keyboardReadLine(const int16_t *args) {
+    outputPrintString(args);
+    out.flush();
+    string line;
+    if (!getline(in, line)) throw Halt {0};
+
+    int16_t length = int16_t(min(line.size(), size_t(255)));
+    int16_t s = stringNew(&length);
+    for (int16_t i = 0; i < length; i++) {
+        int16_t append[] = {s, int16_t(line[i])};
+        stringAppendChar(append);
+    }
+    return s;
+}
+
+int16_t VMInterpreter::keyboardReadInt(const int16_t *args) {
+    int16_t s = keyboardReadLine(args);
+    int16_t value = stringIntValue(&s);
+    memoryDeAlloc(&s);
+    return value;
+}
+
+/* End Private Methods */
+
+
+VMInterpreter::VMInterpreter(ostream &output, istream &input) : ram(32768), out(output), in(input) {}
+
+void VMInterpreter::load(const VMProgram &program, const string &fileName) {
+    uint32_t nStatics = 0;
+    for (const auto &instruction : program.code) {
+        if ((instruction.opcode == Opcode::PUSH || instruction.opcode == Opcode::POP) && Segment(instruction.kind) == Segment::STATIC) {
+            nStatics = max(nStatics, instruction.operand + 1);
+        }
+    }
+    int staticBase = nextStatic;
+    nextStatic += int(nStatics);
+    if (nextStatic > STACK_BASE) {
+        throw runtime_error(fileName + ": more static variables than the 240 words from 16 to 255 hold");
+    }
+
+    size_t begin = program.code.size();
+    for (size_t k = 0; k <= program.code.size(); k++) {
+        if (k == program.code.size() || program.code[k].opcode == Opcode::FUNCTION) {
+            if (begin < k) decodeFunction(program, begin, k, staticBase);
+            begin = k;
+        }
+    }
+}
+
+int VMInterpreter::run() {
+    // the bootstrap: Sys.init, or what the native Sys.init does
+    size_t boot = code.size();
+    auto call = [&](const string &function) {
+        calls.push_back(CallFixup {code.size(), function});
+        code.push_back(Op {nullptr, Code::CALL, 0, 0, 0});
+    };
+    if (functions.count("Sys.init")) {
+        call("Sys.init");
+    } else {
+        for (const char *init : {"Memory.init", "Math.init", "Screen.init", "Output.init", "Keyboard.init"}) {
+            call(init);
+            code.push_back(Op {nullptr, Code::POP_RAM, 0, TEMP, 0});
+        }
+        call("Main.main");
+    }
+    code.push_back(Op {nullptr, Code::HALT, 0, 0, 0});
+
+    // the functions of the program win over the native OS
+    map<string, int32_t> nativeIds;
+    for (const auto &fixup : calls) {
+        Op &op = code[fixup.op];
+        auto function = functions.find(fixup.function);
+        if (function != functions.end()) {
+            op.a = int32_t(function->second);
+            continue;
+        }
+        auto native = natives().find(fixup.function);
+        if (native == natives().end()) {
+            out.flush();
+            throw runtime_error("call to unknown function " + fixup.function);
+        }
+        auto id = nativeIds.emplace(native->first, int32_t(nativeTable.size()));
+        if (id.second) nativeTable.push_back(native->second);
+        op.code = Code::CALL_NATIVE;
+        op.a = id.first->second;
+    }
+    calls.clear();
+    memoryInit(nullptr);
+
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    // in the order of Code
+    static const void *const handlers[] = {
+        &&PUSH_CONST, &&PUSH_LOCAL, &&PUSH_ARG, &&PUSH_THIS, &&PUSH_THAT, &&PUSH_POINTER0, &&PUSH_POINTER1, &&PUSH_RAM,
+        &&POP_LOCAL, &&POP_ARG, &&POP_THIS, &&POP_THAT, &&POP_POINTER0, &&POP_POINTER1, &&POP_RAM,
+        &&ADD, &&SUB, &&NEG, &&EQ, &&GT, &&LT, &&AND, &&OR, &&NOT,
+        &&GOTO, &&IF_GOTO, &&CALL, &&CALL_NATIVE, &&FUNCTION, &&RETURN, &&HALT,
+        &&ADD_CONST, &&SUB_CONST, &&ADD_LOCAL, &&ADD_ARG, &&EQ_CONST, &&GT_CONST, &&LT_CONST,
+        &&JUMP_EQ, &&JUMP_NE, &&JUMP_GT, &&JUMP_LE, &&JUMP_LT, &&JUMP_GE, &&JUMP_UNLESS_TRUE,
+        &&THAT_AT, &&RETURN_CONST
+    };
+    for (auto &op : code) {
+        op.handler = handlers[size_t(op.code)];
+    }
+#endif
+
+    int16_t *mem = ram.data();
+    const Op *base = code.data();
+    const Op *ip = base + boot;
+    // the Hack registers, SP, LCL and ARG as pointers; the frame of every call is in RAM as well,
+    // only the return addresses are kept aside, they are operation indices
+    int16_t *sp = mem + STACK_BASE;
+    int16_t *lcl = sp;
+    int16_t *arg = sp;
+    int16_t pthis = 0;
+    int16_t pthat = 0;
+    vector<const Op *> returns;
+    int16_t value;
+    int16_t x;
+    int16_t y;
+
+    int status = 0;
+    try {
+        NEXT();
+#ifndef THREADED_DISPATCH
+dispatch:
+        switch (ip->code) {
+#endif
+        HANDLER(PUSH_CONST) *sp++ = int16_t(ip->a); ip++; NEXT();
+        HANDLER(PUSH_LOCAL) *sp++ = lcl[ip->a]; ip++; NEXT();
+        HANDLER(PUSH_ARG) *sp++ = arg[ip->a]; ip++; NEXT();
+        HANDLER(PUSH_THIS) *sp++ = RAM(pthis + ip->a); ip++; NEXT();
+        HANDLER(PUSH_THAT) *sp++ = RAM(pthat + ip->a); ip++; NEXT();
+        HANDLER(PUSH_POINTER0) *sp++ = pthis; ip++; NEXT();
+        HANDLER(PUSH_POINTER1) *sp++ = pthat; ip++; NEXT();
+        HANDLER(PUSH_RAM) *sp++ = mem[ip->a]; ip++; NEXT();
+        HANDLER(POP_LOCAL) lcl[ip->a] = *--sp; ip++; NEXT();
+        HANDLER(POP_ARG) arg[ip->a] = *--sp; ip++; NEXT();
+        HANDLER(POP_THIS) RAM(pthis + ip->a) = *--sp; ip++; NEXT();
+        HANDLER(POP_THAT) RAM(pthat + ip->a) = *--sp; ip++; NEXT();
+        HANDLER(POP_POINTER0) pthis = *--sp; ip++; NEXT();
+        HANDLER(POP_POINTER1) pthat = *--sp; ip++; NEXT();
+        HANDLER(POP_RAM) mem[ip->a] = *--sp; ip++; NEXT();
+        HANDLER(ADD) sp--; sp[-1] = int16_t(sp[-1] + sp[0]); ip++; NEXT();
+        HANDLER(SUB) sp--; sp[-1] = int16_t(sp[-1] - sp[0]); ip++; NEXT();
+        HANDLER(NEG) sp[-1] = int16_t(-sp[-1]); ip++; NEXT();
+        HANDLER(EQ) sp--; sp[-1] = sp[-1] == sp[0] ? -1 : 0; ip++; NEXT();
+        HANDLER(GT) sp--; sp[-1] = sp[-1] > sp[0] ? -1 : 0; ip++; NEXT();
+        HANDLER(LT) sp--; sp[-1] = sp[-1] < sp[0] ? -1 : 0; ip++; NEXT();
+        HANDLER(AND) sp--; sp[-1] &= sp[0]; ip++; NEXT();
+        HANDLER(OR) sp--; sp[-1] |= sp[0]; ip++; NEXT();
+        HANDLER(NOT) sp[-1] = int16_t(~sp[-1]); ip++; NEXT();
+        HANDLER(GOTO) ip = base + ip->a; NEXT();
+        HANDLER(IF_GOTO) ip = *--sp ? base + ip->a : ip + 1; NEXT();
+        HANDLER(CALL)
+            if (sp - mem >= STACK_END - 5) {
+                out.flush();
+                throw runtime_error("stack overflow");
+            }
+            returns.push_back(ip + 1);
+            sp[0] = 0;
+            sp[1] = int16_t(lcl - mem);
+            sp[2] = int16_t(arg - mem);
+            sp[3] = pthis;
+            sp[4] = pthat;
+            arg = sp - ip->b;
+            sp += 5;
+            lcl = sp;
+            ip = base + ip->a;
+            NEXT();
+        HANDLER(CALL_NATIVE)
+            sp -= ip->b;
+            *sp = (this->*nativeTable[size_t(ip->a)])(sp);
+            sp++;
+            ip++;
+            NEXT();
+        HANDLER(FUNCTION)
+            for (int32_t i = 0; i < ip->a; i++) *sp++ = 0;
+            ip++;
+            NEXT();
+        HANDLER(RETURN)
+            value = sp[-1];
+            goto leave;
+        HANDLER(RETURN_CONST)
+            value = int16_t(ip->a);
+        leave:
+            *arg = value;
+            sp = arg + 1;
+            pthat = lcl[-1];
+            pthis = lcl[-2];
+            arg = mem + lcl[-3];
+            lcl = mem + lcl[-4];
+            ip = returns.back();
+            returns.pop_back();
+            NEXT();
+        HANDLER(HALT)
+            throw Halt {0};
+        HANDLER(ADD_CONST) sp[-1] = int16_t(sp[-1] + ip->a); ip++; NEXT();
+        HANDLER(SUB_CONST) sp[-1] = int16_t(sp[-1] - ip->a); ip++; NEXT();
+        HANDLER(ADD_LOCAL) sp[-1] = int16_t(sp[-1] + lcl[ip->a]); ip++; NEXT();
+        HANDLER(ADD_ARG) sp[-1] = int16_t(sp[-1] + arg[ip->a]); ip++; NEXT();
+        HANDLER(EQ_CONST) sp[-1] = sp[-1] == int16_t(ip->a) ? -1 : 0; ip++; NEXT();
+        HANDLER(GT_CONST) sp[-1] = sp[-1] > int16_t(ip->a) ? -1 : 0; ip++; NEXT();
+        HANDLER(LT_CONST) sp[-1] = sp[-1] < int16_t(ip->a) ? -1 : 0; ip++; NEXT();
+        HANDLER(JUMP_EQ) sp -= 2; x = sp[0]; y = sp[1]; ip = x == y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_NE) sp -= 2; x = sp[0]; y = sp[1]; ip = x != y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_GT) sp -= 2; x = sp[0]; y = sp[1]; ip = x > y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_LE) sp -= 2; x = sp[0]; y = sp[1]; ip = x <= y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_LT) sp -= 2; x = sp[0]; y = sp[1]; ip = x < y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_GE) sp -= 2; x = sp[0]; y = sp[1]; ip = x >= y ? base + ip->a : ip + 1; NEXT();
+        HANDLER(JUMP_UNLESS_TRUE) ip = *--sp != -1 ? base + ip->a : ip + 1; NEXT();
+        HANDLER(THAT_AT) pthat = sp[-1]; sp[-1] = RAM(pthat); ip++; NEXT();
+#ifndef THREADED_DISPATCH
+        }
+#endif
+    } catch (Halt &halt) {
+        status = halt.status;
+    }
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+    out.flush();
+    return status;
+}
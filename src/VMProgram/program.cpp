@@ -0,0 +1,249 @@
+#include <VMProgram/program.hpp>
+#include <cstring>
+#include <sstream>
+
+using namespace std;
+
+
+/* Begin Helper Function */
+
+static void putVarint(string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static bool getVarint(istream &in, uint64_t &value) {
+    value = 0;
+    for (size_t shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) return false;
+        value |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+static const string SEGMENT_NAMES[] = {"constant", "argument", "local", "static", "this", "that", "pointer", "temp"};
+static const string COMMAND_NAMES[] = {"add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not"};
+
+template <size_t N>
+static int indexIn(const string (&names)[N], const string &name) {
+    for (size_t i = 0; i < N; i++) {
+        if (names[i] == name) return int(i);
+    }
+    return -1;
+}
+
+/* End Helper Function */
+
+
+uint32_t VMProgram::intern(const string &name) {
+    auto result = nameIds.try_emplace(name, uint32_t(names.size()));
+    if (result.second) {
+        names.push_back(name);
+    }
+    return result.first->second;
+}
+
+void VMProgram::add(Opcode opcode, uint8_t kind, uint32_t operand, uint32_t name) {
+    code.push_back(Instruction {opcode, kind, operand, name});
+}
+
+void VMProgram::append(const VMProgram &other) {
+    vector<uint32_t> ids(other.names.size());
+    for (size_t i = 0; i < other.names.size(); i++) {
+        ids[i] = intern(other.names[i]);
+    }
+
+    code.reserve(code.size() + other.code.size());
+    for (Instruction instruction : other.code) {
+        if (instruction.opcode >= Opcode::LABEL && instruction.opcode <= Opcode::FUNCTION) {
+            instruction.name = ids[instruction.name];
+        }
+        code.push_back(instruction);
+    }
+}
+
+void VMProgram::clear() {
+    code.clear();
+    names.clear();
+    nameIds.clear();
+}
+
+void VMProgram::writeText(ostream &out) const {
+    ostringstream text;
+    VMWriter writer(text);
+    for (const auto &instruction : code) {
+        switch (instruction.opcode) {
+            case Opcode::PUSH:
+                writer.writePush(Segment(instruction.kind), instruction.operand);
+                break;
+            case Opcode::POP:
+                writer.writePop(Segment(instruction.kind), instruction.operand);
+                break;
+            case Opcode::ARITHMETIC:
+                writer.writeArithmetic(Command(instruction.kind));
+                break;
+            case Opcode::LABEL:
+                writer.writeLabel(names[instruction.name]);
+                break;
+            case Opcode::GOTO:
+                writer.writeGoto(names[instruction.name]);
+                break;
+            case Opcode::IF_GOTO:
+                writer.writeIf(names[instruction.name]);
+                break;
+            case Opcode::CALL:
+                writer.writeCall(names[instruction.name], instruction.operand);
+                break;
+            case Opcode::FUNCTION:
+                writer.writeFunction(names[instruction.name], instruction.operand);
+                break;
+            case Opcode::RETURN:
+                writer.writeReturn();
+                break;
+        }
+    }
+    writer.flush();
+    out << text.str();
+}
+
+void VMProgram::writeBinary(ostream &out) const {
+    string data (MAGIC, 4);
+    data.push_back(char(VERSION));
+
+    putVarint(data, names.size());
+    for (const auto &name : names) {
+        putVarint(data, name.size());
+        data += name;
+    }
+
+    putVarint(data, code.size());
+    for (const auto &instruction : code) {
+        data.push_back(char(uint8_t(instruction.opcode) << 4 | instruction.kind));
+        switch (instruction.opcode) {
+            case Opcode::PUSH:
+            case Opcode::POP:
+                putVarint(data, instruction.operand);
+                break;
+            case Opcode::LABEL:
+            case Opcode::GOTO:
+            case Opcode::IF_GOTO:
+                putVarint(data, instruction.name);
+                break;
+            case Opcode::CALL:
+            case Opcode::FUNCTION:
+                putVarint(data, instruction.name);
+                putVarint(data, instruction.operand);
+                break;
+            case Opcode::ARITHMETIC:
+            case Opcode::RETURN:
+                break;
+        }
+    }
+
+    out.write(data.data(), data.size());
+}
+
+bool VMProgram::readBinary(istream &in, VMProgram &program) {
+    program.clear();
+
+    char magic[4];
+    if (!in.read(magic, 4) || memcmp(magic, MAGIC, 4) != 0 || in.get() != VERSION) {
+        return false;
+    }
+
+    uint64_t nNames;
+    if (!getVarint(in, nNames)) return false;
+    for (uint64_t i = 0; i < nNames; i++) {
+        uint64_t size;
+        if (!getVarint(in, size) || size > (1 << 20)) return false;
+        string name(size, '\0');
+        if (!in.read(name.data(), size)) return false;
+        program.intern(name);
+    }
+
+    uint64_t nInstructions;
+    if (!getVarint(in, nInstructions)) return false;
+    program.code.reserve(min<uint64_t>(nInstructions, 1 << 20));
+    for (uint64_t i = 0; i < nInstructions; i++) {
+        int byte = in.get();
+        if (byte == EOF || (byte >> 4) > int(Opcode::RETURN)) return false;
+
+        Instruction instruction {Opcode(byte >> 4), uint8_t(byte & 0xf), 0, 0};
+        uint64_t name = 0;
+        uint64_t operand = 0;
+        bool ok = true;
+        switch (instruction.opcode) {
+            case Opcode::PUSH:
+            case Opcode::POP:
+                ok = instruction.kind <= uint8_t(Segment::TEMP) && getVarint(in, operand);
+                break;
+            case Opcode::ARITHMETIC:
+                ok = instruction.kind <= uint8_t(Command::NOT);
+                break;
+            case Opcode::LABEL:
+            case Opcode::GOTO:
+            case Opcode::IF_GOTO:
+                ok = getVarint(in, name);
+                break;
+            case Opcode::CALL:
+            case Opcode::FUNCTION:
+                ok = getVarint(in, name) && getVarint(in, operand);
+                break;
+            case Opcode::RETURN:
+                break;
+        }
+        if (!ok || name >= program.names.size() || operand > UINT32_MAX) return false;
+
+        instruction.name = uint32_t(name);
+        instruction.operand = uint32_t(operand);
+        program.code.push_back(instruction);
+    }
+
+    return true;
+}
+
+bool VMProgram::readText(istream &in, VMProgram &program) {
+    program.clear();
+
+    string line;
+    while (getline(in, line)) {
+        line = line.substr(0, line.find("//"));
+        istringstream words(line);
+        string command;
+        if (!(words >> command)) continue;
+
+        string name;
+        long long number = 0;
+        int kind;
+        if (command == "push" || command == "pop") {
+            if (!(words >> name >> number) || (kind = indexIn(SEGMENT_NAMES, name)) < 0) return false;
+            program.add(command == "push" ? Opcode::PUSH : Opcode::POP, uint8_t(kind), uint32_t(number));
+        } else if ((kind = indexIn(COMMAND_NAMES, command)) >= 0) {
+            program.add(Opcode::ARITHMETIC, uint8_t(kind), 0);
+        } else if (command == "label" || command == "goto" || command == "if-goto") {
+            if (!(words >> name)) return false;
+            Opcode opcode = command == "label" ? Opcode::LABEL : command == "goto" ? Opcode::GOTO : Opcode::IF_GOTO;
+            program.add(opcode, 0, 0, program.intern(name));
+        } else if (command == "call" || command == "function") {
+            if (!(words >> name >> number)) return false;
+            program.add(command == "call" ? Opcode::CALL : Opcode::FUNCTION, 0, uint32_t(number), program.intern(name));
+        } else if (command == "return") {
+            program.add(Opcode::RETURN, 0, 0);
+        } else {
+            return false;
+        }
+
+        if (number < 0 || number > UINT32_MAX) return false;
+    }
+
+    return true;
+}
+
+bool VMProgram::isBinary(string_view data) {
+    return data.size() >= 4 && data.substr(0, 4) == string_view(MAGIC, 4);
+}
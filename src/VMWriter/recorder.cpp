@@ -0,0 +1,98 @@
+#include <VMWriter/recorder.hpp>
+#include <sstream>
+
+using namespace std;
+
+
+/* Begin Private Methods */
+
+void VMRecorder::record(Opcode opcode, uint8_t kind, int operand, const string *name) {
+    output->push_back(Instruction {opcode, kind, uint32_t(operand), name ? program.intern(*name) : 0});
+}
+
+/* End Private Methods */
+
+
+void VMRecorder::reserveHeader() {
+    headers.push_back(HeaderSlot {program.code.size(), headerCode.size(), headerCode.size()});
+    output = &program.code;
+}
+
+void VMRecorder::startHeader() {
+    headers.back().begin = headerCode.size();
+    output = &headerCode;
+}
+
+void VMRecorder::endHeader() {
+    headers.back().end = headerCode.size();
+    output = &program.code;
+}
+
+void VMRecorder::writePush(Segment segment, int index) {
+    record(Opcode::PUSH, uint8_t(segment), index);
+}
+
+void VMRecorder::writePop(Segment segment, int index) {
+    record(Opcode::POP, uint8_t(segment), index);
+}
+
+void VMRecorder::writeArithmetic(Command command) {
+    record(Opcode::ARITHMETIC, uint8_t(command), 0);
+}
+
+void VMRecorder::writeLabel(const string &label) {
+    record(Opcode::LABEL, 0, 0, &label);
+}
+
+void VMRecorder::writeGoto(const string &label) {
+    record(Opcode::GOTO, 0, 0, &label);
+}
+
+void VMRecorder::writeIf(const string &label) {
+    record(Opcode::IF_GOTO, 0, 0, &label);
+}
+
+void VMRecorder::writeCall(const string &name, int nArgs) {
+    record(Opcode::CALL, 0, nArgs, &name);
+}
+
+void VMRecorder::writeFunction(const string &name, int nLocals) {
+    record(Opcode::FUNCTION, 0, nLocals, &name);
+}
+
+void VMRecorder::writeReturn() {
+    record(Opcode::RETURN, 0, 0);
+}
+
+// code is what another recorder flushed, possibly several programs
+void VMRecorder::writeCompiled(const string &code) {
+    istringstream in(code);
+    VMProgram part;
+    while (VMProgram::readBinary(in, part)) {
+        program.append(part);
+    }
+}
+
+void VMRecorder::flush() {
+    if (program.code.empty() && headerCode.empty()) {
+        return;
+    }
+
+    if (!headers.empty()) {
+        vector<Instruction> code;
+        code.reserve(program.code.size() + headerCode.size());
+        size_t copied = 0;
+        for (const auto &slot : headers) {
+            code.insert(code.end(), program.code.begin() + copied, program.code.begin() + slot.position);
+            code.insert(code.end(), headerCode.begin() + slot.begin, headerCode.begin() + slot.end);
+            copied = slot.position;
+        }
+        code.insert(code.end(), program.code.begin() + copied, program.code.end());
+        program.code = move(code);
+    }
+
+    program.writeBinary(fileStream);
+    program.clear();
+    headerCode.clear();
+    headers.clear();
+}
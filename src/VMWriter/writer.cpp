@@ -1,10 +1,27 @@
 #include <VMWriter/writer.hpp>
+#include <VMWriter/recorder.hpp>
+#include <charconv>
 #include <iostream>
 #include <fstream>
+#include <string_view>
 
 using namespace std;
 
 
+/* instruction text up to the index, indexed by Segment and Command */
+static const string_view PUSH_TEXT[] = {
+    "    push constant ", "    push argument ", "    push local ", "    push static ",
+    "    push this ", "    push that ", "    push pointer ", "    push temp "
+};
+static const string_view POP_TEXT[] = {
+    "    pop constant ", "    pop argument ", "    pop local ", "    pop static ",
+    "    pop this ", "    pop that ", "    pop pointer ", "    pop temp "
+};
+static const string_view COMMAND_TEXT[] = {
+    "    add\n", "    sub\n", "    neg\n", "    eq\n", "    gt\n", "    lt\n", "    and\n", "    or\n", "    not\n"
+};
+
+
 ostream &operator<<(ostream &out, Segment seg) {
     switch (seg) {
         case Segment::ARG:
@@ -91,72 +108,106 @@ Command charToCommand(char c) {
     }
 }
 
-Segment kindToSegment(Kind k) {
-    switch(k) {
-        case Kind::ARG:
-            return Segment::ARG;
-        case Kind::FIELD:
-            return Segment::THIS;
-        case Kind::STATIC:
-            return Segment::STATIC;
-        case Kind::VAR:
-            return Segment::LOCAL;
-        default:
-            throw runtime_error("Cannot convert kind to segment");
+
+/* Begin Private Methods */
+
+void VMWriter::writeIndex(int index) {
+    char digits[16];
+    auto result = to_chars(digits, digits + sizeof(digits) - 1, index);
+    *result.ptr = '\n';
+    output->append(digits, result.ptr + 1);
+}
+
+void VMWriter::flushIfFull() {
+    if (fileBuffer.size() >= FLUSH_SIZE) {
+        flush();
     }
 }
 
+/* End Private Methods */
 
-void VMWriter::switchBuffer(Buffer bf) {
-    switch (bf) {
-        case Buffer::FILE:
-            output = &fileBuffer;
-            break;
-        case Buffer::STRING:
-            output = &stringBuffer;
-            break;
+
+unique_ptr<VMWriter> VMWriter::create(ostream &out, VMFormat format) {
+    if (format == VMFormat::BINARY) {
+        return make_unique<VMRecorder>(out);
     }
+    return make_unique<VMWriter>(out);
+}
+
+void VMWriter::reserveHeader() {
+    headers.push_back(HeaderSlot {fileBuffer.size(), headerBuffer.size(), headerBuffer.size()});
+    output = &fileBuffer;
+}
+
+void VMWriter::startHeader() {
+    headers.back().begin = headerBuffer.size();
+    output = &headerBuffer;
+}
+
+// a finished subroutine is the natural point to hand a full buffer on
+void VMWriter::endHeader() {
+    headers.back().end = headerBuffer.size();
+    output = &fileBuffer;
+    flushIfFull();
 }
 
 void VMWriter::writePush(Segment segment, int index) {
-    *output << string(INDENT_SIZE, ' ') << "push " << segment << " " << index << endl;
+    output->append(PUSH_TEXT[static_cast<size_t>(segment)]);
+    writeIndex(index);
 }
 
 void VMWriter::writePop(Segment segment, int index) {
-    *output << string(INDENT_SIZE, ' ') << "pop " << segment << " " << index << endl;
+    output->append(POP_TEXT[static_cast<size_t>(segment)]);
+    writeIndex(index);
 }
 
 void VMWriter::writeArithmetic(Command command) {
-    *output << string(INDENT_SIZE, ' ') << command << endl;
+    output->append(COMMAND_TEXT[static_cast<size_t>(command)]);
 }
 
-void VMWriter::writeLabel(string label) {
-    *output << "label " << label << endl;
+void VMWriter::writeLabel(const string &label) {
+    output->append("label ").append(label).push_back('\n');
 }
 
-void VMWriter::writeGoto(string label) {
-    *output << string(INDENT_SIZE, ' ') << "goto " << label << endl;
+void VMWriter::writeGoto(const string &label) {
+    output->append("    goto ").append(label).push_back('\n');
 }
 
-void VMWriter::writeIf(string label) {
-    *output << string(INDENT_SIZE, ' ') << "if-goto " << label << endl;
+void VMWriter::writeIf(const string &label) {
+    output->append("    if-goto ").append(label).push_back('\n');
 }
 
-void VMWriter::writeCall(string name, int nArgs) {
-    *output << string(INDENT_SIZE, ' ') << "call " << name << " " << nArgs << endl;
+void VMWriter::writeCall(const string &name, int nArgs) {
+    output->append("    call ").append(name).push_back(' ');
+    writeIndex(nArgs);
 }
 
-void VMWriter::writeFunction(string name, int nLocals) {
-    *output << "function " << name << " " << nLocals << endl;
+void VMWriter::writeFunction(const string &name, int nLocals) {
+    output->append("function ").append(name).push_back(' ');
+    writeIndex(nLocals);
 }
 
 void VMWriter::writeReturn() {
-    *output << string(INDENT_SIZE, ' ') << "return" << endl;
+    output->append("    return\n");
 }
 
-void VMWriter::writeNow() {
-    fileBuffer << stringBuffer.str();
-    stringBuffer.str("");
+void VMWriter::writeCompiled(const string &code) {
+    output->append(code);
+    flushIfFull();
+}
+
+void VMWriter::flush() {
+    size_t written = 0;
+    for (const auto &slot : headers) {
+        fileStream.write(fileBuffer.data() + written, slot.position - written);
+        fileStream.write(headerBuffer.data() + slot.begin, slot.end - slot.begin);
+        written = slot.position;
+    }
+    fileStream.write(fileBuffer.data() + written, fileBuffer.size() - written);
+
+    fileBuffer.clear();
+    headerBuffer.clear();
+    headers.clear();
 }
 
 size_t VMWriter::getUniq() {
@@ -167,3 +218,7 @@ string VMWriter::generateLabel() {
     size_t id = getUniq();
     return "L" + to_string(id);
 }
+
+void VMWriter::startLabelsAt(size_t id) {
+    uniq = id;
+}
@@ -1,22 +1,129 @@
 #include <JackAnalyzer/analyzer.hpp>
+#include <CompileServer/server.hpp>
+#include <TimeReport/alloc.hpp>
+#include <TimeReport/report.hpp>
 #include <VMWriter/writer.hpp>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace std;
+namespace fs = filesystem;
 
 
 int main(int argc, char **argv) {
     if (argc < 2) {
-        cout << "Usage jc <filename or dirname>" << endl;
+        cout << "Usage jc <filename, dirname or - for stdin> [--print-xml] [--cache] [--cache-dir=<dir>] [--pipeline-lexer] [--parallel-subroutines] [--binary] [--asm] [--c] [--instrument] [--profile=<file>] [--run] [--time-report[=json]] [--alloc-report[=json]] [--watch] [--connect=<socket>]" << endl;
+        cout << "      jc --server=<socket>" << endl;
+        cout << "      jc --batch=<manifest> [--binary] [--instrument] [--profile=<file>] [--pipeline-lexer] [--parallel-subroutines]" << endl;
+        cout << "      jc --dump=<file.vmb>" << endl;
         return 1;
     }
 
-    if (argc >= 3) {
-        if (string(argv[2]) == "--print-xml") {
+    string first = argv[1];
+    bool server = first.rfind("--server=", 0) == 0;
+    bool dump = first.rfind("--dump=", 0) == 0;
+    if ((server || dump) && argc > 2) {
+        cerr << (server ? "--server" : "--dump") << " takes no other options" << endl;
+        return 1;
+    }
+    if (server) {
+        return CompileServer::serve(first.substr(string("--server=").size()));
+    }
+    if (dump) {
+        return JackAnalyzer::dump(first.substr(string("--dump=").size()));
+    }
+
+    string socketPath;
+    string forwardedOptions;
+    bool watch = false;
+    for (int i = 2; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--print-xml") {
             JackAnalyzer::printXml = true;
+        } else if (option == "--cache") {
+            JackAnalyzer::useCache = true;
+        } else if (option.rfind("--cache-dir=", 0) == 0) {
+            JackAnalyzer::useCache = true;
+            JackAnalyzer::cacheDir = option.substr(string("--cache-dir=").size());
+            option = "--cache-dir=" + fs::absolute(JackAnalyzer::cacheDir).string();
+        } else if (option == "--pipeline-lexer") {
+            JackAnalyzer::pipelinedLexer = true;
+        } else if (option == "--parallel-subroutines") {
+            JackAnalyzer::parallelSubroutines = true;
+        } else if (option == "--binary") {
+            JackAnalyzer::vmFormat = VMFormat::BINARY;
+        } else if (option == "--asm") {
+            JackAnalyzer::emitAsm = true;
+        } else if (option == "--c") {
+            JackAnalyzer::emitC = true;
+        } else if (option == "--instrument") {
+            JackAnalyzer::instrument = true;
+        } else if (option.rfind("--profile=", 0) == 0) {
+            fs::path file = option.substr(string("--profile=").size());
+            if (!Profile::read(file, JackAnalyzer::profile)) {
+                cerr << "Warning: can't read the profile " << file.string() << ", compiling without it" << endl;
+            }
+            option = "--profile=" + fs::absolute(file).string();
+        } else if (option == "--time-report" || option == "--time-report=json") {
+            TimeReport::enabled = true;
+            TimeReport::json = option == "--time-report=json";
+        } else if (option == "--alloc-report" || option == "--alloc-report=json") {
+            AllocationCounter::counting = true;
+            AllocationCounter::json = option == "--alloc-report=json";
+        } else if (option == "--run") {
+            JackAnalyzer::runProgram = true;
+        } else if (option == "--watch") {
+            watch = true;
+            continue;
+        } else if (option.rfind("--connect=", 0) == 0) {
+            socketPath = option.substr(string("--connect=").size());
+            continue;
+        } else {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+        forwardedOptions += " " + option;
+    }
+
+    // a batch compiles every project to VM code, other outputs and reports don't apply
+    if (first.rfind("--batch=", 0) == 0) {
+        if (JackAnalyzer::printXml || JackAnalyzer::useCache || JackAnalyzer::emitAsm || JackAnalyzer::emitC
+                || JackAnalyzer::runProgram || TimeReport::enabled || AllocationCounter::counting || watch || !socketPath.empty()) {
+            cerr << "--batch only takes --binary, --instrument, --profile, --pipeline-lexer and --parallel-subroutines" << endl;
+            return 1;
         }
+        return JackAnalyzer::batch(first.substr(string("--batch=").size()));
+    }
+
+    // thin client, the resident server does the work
+    if (!socketPath.empty()) {
+        if (watch) {
+            cerr << "--watch can't be combined with --connect" << endl;
+            return 1;
+        }
+        ostringstream header;
+        if (first == "-") {
+            // stdin is sent along, the server compiles it in memory
+            ostringstream source;
+            source << cin.rdbuf();
+            header << "SOURCE " << source.str().size() << forwardedOptions;
+            return CompileServer::forward(socketPath, header.str(), source.str());
+        }
+        header << "COMPILE " << quoted(fs::absolute(first).string()) << forwardedOptions;
+        return CompileServer::forward(socketPath, header.str());
+    }
+
+    if (watch) {
+        return JackAnalyzer::watch(first);
+    }
+
+    // streaming mode: jack from stdin, vm to stdout
+    if (first == "-") {
+        return JackAnalyzer::compileStream(cin, cout) ? 0 : 1;
     }
 
-    JackAnalyzer::analyze(argv[1]);
+    return JackAnalyzer::analyze(first) ? 0 : 1;
 }